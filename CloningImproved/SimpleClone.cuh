@@ -78,7 +78,7 @@ public:
 		rootClone = new SimpleClone(this, NULL, NULL);
 		clones = new thrust::host_vector<SimpleClone*>();
 
-		randomHost = new GRandom(modelHostParams.MAX_AGENT_NO);
+		randomHost = new GRandom();
 		util::hostAllocCopyToDevice<GRandom>(randomHost, &random);
 
 		util::hostAllocCopyToDevice<SimpleModel>(this, (SimpleModel**)&model);
@@ -139,7 +139,7 @@ public:
 		//doSomethingWith();
 		SimpleModel *myModel = (SimpleModel*)model;
 		myClone->obst;
-		myModel->random->uniform();
+		myModel->random->uniform(this->contextId, 0);
 	}
 
 	__device__ void init(int dataSlot, SimpleClone *myClone) {
@@ -206,7 +206,7 @@ __device__ bool SimpleClone::cloningConditionDev(SimpleAgent *parentAgent){
 	// doSomethingWith(this->obst, parentAgent);
 	// 2. check existing child agents with parent agent
 	// doSomethingWith(this->agents, parentAgent);
-	float r = this->myModel->random->uniform();
+	float r = this->myModel->random->uniform(parentAgent->contextId, 1);
 	return r < 0.2;
 }
 
@@ -201,8 +201,8 @@ public:
 
 		cloneid = cloneCount++;
 
-		int r = rand();
-		memcpy(&color, &r, sizeof(uchar4));
+		uint4 r = util::randomBits(modelHostParams.RANDOM_SEED, cloneid, 0, 0);
+		memcpy(&color, &r.x, sizeof(uchar4));
 
 		memcpy(this->cloneidArray, cloneidArrayVal, NUM_GATES * sizeof(int));
 
@@ -285,7 +285,6 @@ public:
 		cudaMemcpyToSymbol(gate2Sizes, &gateSizeHost, NUM_GATE_0_CHOICES * sizeof(double));
 #else
 		double gate0SizesHost[NUM_GATE_0_CHOICES];
-		srand(0);
 		for (int j = 0; j < NUM_GATE_0_CHOICES; j++)
 			gate0SizesHost[j] = 2+j;
 		cudaMemcpyToSymbol(gate0Sizes, &gate0SizesHost[0], NUM_GATE_0_CHOICES * sizeof(double));
@@ -338,7 +337,7 @@ public:
 		cudaEventCreate(&rootClone->cloneEvent, cudaEventDisableTiming);
 
 		//init utility
-		randomHost = new GRandom(modelHostParams.MAX_AGENT_NO);
+		randomHost = new GRandom();
 		util::hostAllocCopyToDevice<GRandom>(randomHost, &random);
 
 		util::hostAllocCopyToDevice<SocialForceRoomModel>(this, (SocialForceRoomModel**)&this->model);
@@ -1150,8 +1149,8 @@ public:
 			SocialForceRoomAgentData dataLocal; //= &sfModel->originalAgents->dataArray[dataSlot];
 
 			dataLocal.agentPtr = this;
-			dataLocal.loc.x = (0.5 + 0.4 * this->random->uniform()) * modelDevParams.WIDTH - 0.1;
-			dataLocal.loc.y = (0.5 + 0.4 * this->random->uniform()) * modelDevParams.HEIGHT - 0.1;
+			dataLocal.loc.x = (0.5 + 0.4 * this->random->uniform(dataSlot, 0)) * modelDevParams.WIDTH - 0.1;
+			dataLocal.loc.y = (0.5 + 0.4 * this->random->uniform(dataSlot, 1)) * modelDevParams.HEIGHT - 0.1;
 			dataLocal.velocity.x = 2;//4 * (this->random->uniform()-0.5);
 			dataLocal.velocity.y = 2;//4 * (this->random->uniform()-0.5);
 
@@ -0,0 +1,97 @@
+#ifndef CLONE_TRANSPORT_H
+#define CLONE_TRANSPORT_H
+
+#include <Windows.h>
+#include <string.h>
+
+/* moves the per-step state of a clone from the process that steps it to the worker processes
+running its child subtrees. Every step has an epoch, a worker asks for the epoch it needs and
+either gets it, waits for it, or learns that it is gone and has to compute it itself. A
+worker registers with an ack of step 0 and the publisher waits for every worker to register
+before the first step. A transport between hosts only has to implement the same four calls */
+class CloneTransport {
+public:
+	virtual ~CloneTransport() {}
+	// makes buf the state of step for every worker
+	virtual void publish(int step, const void *buf, size_t bytes) = 0;
+	// copies the state of step into buf: 1 done, 0 not published yet, -1 no longer held
+	virtual int fetch(int step, void *buf, size_t bytes) = 0;
+	// worker rank has consumed step, doubles as its heartbeat
+	virtual void ack(int rank, int step) = 0;
+	// worker rank has acked at least once
+	virtual bool joined(int rank) = 0;
+};
+
+#define RING_DEPTH 4			// steps held by the ring
+#define MAX_WORKERS 64
+#define WORKER_TIMEOUT_MS 5000	// a worker without ack for this long is treated as lost
+
+/* ring of RING_DEPTH step slots in a named file mapping shared by all processes on the host.
+A slot is overwritten only after every live worker acked the step it holds, the epoch of a
+slot is -1 while it is written and the reader checks it again after copying */
+class SharedMemoryTransport : public CloneTransport {
+	struct RingHeader {
+		volatile LONG64 epoch[RING_DEPTH];
+		volatile LONG64 doneStep[MAX_WORKERS];
+		volatile LONG64 heartbeat[MAX_WORKERS];
+	};
+	HANDLE mapping;
+	RingHeader *header;
+	char *slots;
+	size_t slotBytes;
+	int numWorkers;
+
+	bool workerLive(int rank) {
+		return GetTickCount64() - header->heartbeat[rank] < WORKER_TIMEOUT_MS;
+	}
+	LONG64 latestEpoch() {
+		LONG64 latest = 0;
+		for (int i = 0; i < RING_DEPTH; i++)
+			if (header->epoch[i] > latest)
+				latest = header->epoch[i];
+		return latest;
+	}
+public:
+	// the mapping is zero filled on creation, epoch 0 is never published since steps start at 1
+	SharedMemoryTransport(const char *name, size_t slotBytes, int numWorkers)
+		: slotBytes(slotBytes), numWorkers(numWorkers) {
+		size_t size = sizeof(RingHeader) + RING_DEPTH * slotBytes;
+		mapping = CreateFileMappingA(INVALID_HANDLE_VALUE, NULL, PAGE_READWRITE,
+			(DWORD)((unsigned long long)size >> 32), (DWORD)size, name);
+		header = (RingHeader*)MapViewOfFile(mapping, FILE_MAP_ALL_ACCESS, 0, 0, size);
+		slots = (char*)header + sizeof(RingHeader);
+	}
+	bool good() {
+		return header != NULL;
+	}
+	void publish(int step, const void *buf, size_t bytes) {
+		int slot = step % RING_DEPTH;
+		for (int r = 1; r < numWorkers; r++)
+			while (header->doneStep[r] < step - RING_DEPTH && workerLive(r))
+				Sleep(0);
+		InterlockedExchange64(&header->epoch[slot], -1);
+		memcpy(slots + slot * slotBytes, buf, bytes);
+		MemoryBarrier();
+		InterlockedExchange64(&header->epoch[slot], step);
+	}
+	int fetch(int step, void *buf, size_t bytes) {
+		int slot = step % RING_DEPTH;
+		if (header->epoch[slot] != step)
+			return latestEpoch() > step ? -1 : 0;
+		MemoryBarrier();
+		memcpy(buf, slots + slot * slotBytes, bytes);
+		MemoryBarrier();
+		if (header->epoch[slot] != step)
+			return -1;
+		return 1;
+	}
+	void ack(int rank, int step) {
+		InterlockedExchange64(&header->doneStep[rank], step);
+		InterlockedExchange64(&header->heartbeat[rank], GetTickCount64());
+	}
+	bool joined(int rank) {
+		return header->heartbeat[rank] != 0;
+	}
+};
+
+#endif
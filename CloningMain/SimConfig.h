@@ -0,0 +1,118 @@
+#ifndef SIM_CONFIG_H
+#define SIM_CONFIG_H
+
+#include <Windows.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* the model dimensions of a run. Every key has a type and a range, a config file holds
+"key=value" lines, '#' starts a comment. A missing file leaves the defaults, which are the
+dimensions the engine was tuned with. numParam and numWalls are the gates and walls of the
+scenario geometry, coded in SocialForceClone, so they are checked but cannot change */
+struct SimConfig {
+	int numCap;		// agents per clone
+	int numParam;
+	int envDim;
+	int numCell;	// neighbor cells per dimension
+	int cellDim;	// envDim / numCell
+	int radiusI;	// interaction radius, upper bound of g_cutoff
+	int numWalls;
+	int randomSeed;	// < 0: the default seed of randGen
+	int toleranceExp;	// > 0: cutoffs from the force tolerance 10^-toleranceExp, 0: RADIUS_I
+
+	struct Key {
+		const char *name;
+		size_t offset;
+		int minValue;
+		int maxValue;
+	};
+
+	static const Key *keys(int &numKey) {
+		static const Key table[] = {
+			{ "NUM_CAP", offsetof(SimConfig, numCap), 1, 1 << 20 },
+			{ "NUM_PARAM", offsetof(SimConfig, numParam), 3, 3 },
+			{ "ENV_DIM", offsetof(SimConfig, envDim), 1, 1 << 16 },
+			{ "NUM_CELL", offsetof(SimConfig, numCell), 1, 1 << 12 },
+			{ "CELL_DIM", offsetof(SimConfig, cellDim), 1, 1 << 16 },
+			{ "RADIUS_I", offsetof(SimConfig, radiusI), 1, 1 << 16 },
+			{ "NUM_WALLS", offsetof(SimConfig, numWalls), 10, 10 },
+			{ "RANDOM_SEED", offsetof(SimConfig, randomSeed), -1, 0x7fffffff },
+			{ "FORCE_TOLERANCE_EXP", offsetof(SimConfig, toleranceExp), 0, 15 },
+		};
+		numKey = sizeof(table) / sizeof(Key);
+		return table;
+	}
+
+	SimConfig() {
+		setDefaults();
+	}
+	void setDefaults() {
+		numCap = 128;
+		numParam = 3;
+		envDim = 128;
+		numCell = 8;
+		cellDim = 16;
+		radiusI = 6;
+		numWalls = 10;
+		randomSeed = -1;
+		toleranceExp = 0;
+	}
+
+	static void report(const char *path, int line, const char *what) {
+		char message[256];
+		sprintf_s(message, 256, "%s:%d: %s\n", path, line, what);
+		OutputDebugStringA(message);
+	}
+
+	/* false if the file has an unknown key, a value that is not a number or out of range, or
+	dimensions that do not fit together. The run then keeps the defaults */
+	bool load(const char *path) {
+		setDefaults();
+		FILE *file = NULL;
+		if (fopen_s(&file, path, "r") != 0 || file == NULL)
+			return true;
+
+		int numKey;
+		const Key *table = keys(numKey);
+		char buf[256];
+		bool good = true;
+		for (int line = 1; fgets(buf, sizeof(buf), file) != NULL; line++) {
+			char *comment = strchr(buf, '#');
+			if (comment != NULL)
+				*comment = 0;
+			char *name = strtok(buf, "= \t\r\n");
+			if (name == NULL)
+				continue;
+			char *value = strtok(NULL, "= \t\r\n");
+			int k = 0;
+			while (k < numKey && strcmp(table[k].name, name) != 0)
+				k++;
+			if (k == numKey) {
+				report(path, line, "unknown key");
+				good = false;
+				continue;
+			}
+			char *end = NULL;
+			long v = value == NULL ? 0 : strtol(value, &end, 10);
+			if (value == NULL || *end != 0 || v < table[k].minValue || v > table[k].maxValue) {
+				report(path, line, "value missing, not an integer or out of range");
+				good = false;
+				continue;
+			}
+			*(int*)((char*)this + table[k].offset) = (int)v;
+		}
+		fclose(file);
+
+		if (good && numCell * cellDim != envDim) {
+			report(path, 0, "NUM_CELL * CELL_DIM must be ENV_DIM");
+			good = false;
+		}
+		if (!good)
+			setDefaults();
+		return good;
+	}
+};
+
+#endif
@@ -152,6 +152,7 @@ namespace util {
 
 #define BLOCK_SIZE 32
 #define GRID_SIZE(n) (n%BLOCK_SIZE==0 ? n/BLOCK_SIZE : n/BLOCK_SIZE + 1)
+#define COMPACT_BLOCK 256
 
 /* application related constants */
 #define	tao 0.5
@@ -172,11 +173,42 @@ namespace util {
 
 #define NUM_WALLS 12
 #define DRAW_OBSTACLE
+#define SHARED_SCENE
 
 class SocialForceAgent;
 class SocialForceClone;
 
+/* walls and gates of the scenario, identical for every clone, so kept once on the host
+and once in constant memory. A clone only records which gates are closed, one bit per
+parameter in gateMask (NUM_PARAM must not exceed 64) */
+class SceneGeometry {
+public:
+	obstacleLine walls[NUM_WALLS];
+	obstacleLine gates[NUM_PARAM];
+
+	__host__ void init(obstacleLine *globalGates) {
+		walls[0].init(0.05 * ENV_DIM, 0.05 * ENV_DIM, 0.05 * ENV_DIM, 0.25 * ENV_DIM);
+		walls[1].init(0.05 * ENV_DIM, 0.35 * ENV_DIM, 0.05 * ENV_DIM, 0.65 * ENV_DIM);
+		walls[2].init(0.05 * ENV_DIM, 0.75 * ENV_DIM, 0.05 * ENV_DIM, 0.95 * ENV_DIM);
+
+		walls[3].init(0.95 * ENV_DIM, 0.05 * ENV_DIM, 0.95 * ENV_DIM, 0.25 * ENV_DIM);
+		walls[4].init(0.95 * ENV_DIM, 0.35 * ENV_DIM, 0.95 * ENV_DIM, 0.65 * ENV_DIM);
+		walls[5].init(0.95 * ENV_DIM, 0.75 * ENV_DIM, 0.95 * ENV_DIM, 0.95 * ENV_DIM);
+
+		walls[6].init(0.05 * ENV_DIM, 0.05 * ENV_DIM, 0.25 * ENV_DIM, 0.05 * ENV_DIM);
+		walls[7].init(0.35 * ENV_DIM, 0.05 * ENV_DIM, 0.65 * ENV_DIM, 0.05 * ENV_DIM);
+		walls[8].init(0.75 * ENV_DIM, 0.05 * ENV_DIM, 0.95 * ENV_DIM, 0.05 * ENV_DIM);
+
+		walls[9].init(0.05 * ENV_DIM, 0.95 * ENV_DIM, 0.25 * ENV_DIM, 0.95 * ENV_DIM);
+		walls[10].init(0.35 * ENV_DIM, 0.95 * ENV_DIM, 0.65 * ENV_DIM, 0.95 * ENV_DIM);
+		walls[11].init(0.75 * ENV_DIM, 0.95 * ENV_DIM, 0.95 * ENV_DIM, 0.95 * ENV_DIM);
+
+		memcpy(gates, globalGates, sizeof(obstacleLine) * NUM_PARAM);
+	}
+};
+
 __constant__ int stepCountDev;
+__constant__ SceneGeometry sceneDev;
 
 typedef struct {
 	double2 goal;
@@ -219,11 +251,13 @@ public:
 	SocialForceAgent *agentArray;
 	SocialForceAgent **agentPtrArray;
 	int *takenFlags;
+	SocialForceAgent **agentPtrScratch; // scatter target of compactKernel
 	//int numElem;
 
 	__host__ AgentPool(int numCap) {
 		cudaMalloc((void**)&agentArray, sizeof(SocialForceAgent) * numCap * 1.5);
 		cudaMalloc((void**)&agentPtrArray, sizeof(SocialForceAgent*) * numCap);
+		cudaMalloc((void**)&agentPtrScratch, sizeof(SocialForceAgent*) * numCap);
 		cudaMalloc((void**)&takenFlags, sizeof(int) * numCap);
 		cudaMemset(takenFlags, 0, sizeof(int) * numCap);
 		
@@ -266,8 +300,8 @@ public:
 	SocialForceAgent **context;
 	bool *cloneFlags;
 	int cloneParams[NUM_PARAM];
-	obstacleLine walls[NUM_WALLS];
-	obstacleLine gates[NUM_PARAM];
+	unsigned long long gateMask;
+	SceneGeometry *scene;
 	bool takenMap[NUM_CELL * NUM_CELL];
 	SocialForceClone *selfDev;
 	cudaStream_t myStream;
@@ -286,7 +320,7 @@ public:
 		return (xr <= 0 && yr <= 0);
 	}
 
-	__host__ void init(int id, int pv1[NUM_PARAM], obstacleLine *globalGates) {
+	__host__ void init(int id, int pv1[NUM_PARAM], SceneGeometry *sceneHost) {
 		default_random_engine randGen(13);
 		uniform_real_distribution<double> distr(0.0, 1.0);
 
@@ -307,31 +341,17 @@ public:
 		memcpy(cloneParams, pv1, sizeof(int) * NUM_PARAM);
 		cudaStreamCreate(&myStream);
 		
-		walls[0].init(0.05 * ENV_DIM, 0.05 * ENV_DIM, 0.05 * ENV_DIM, 0.25 * ENV_DIM);
-		walls[1].init(0.05 * ENV_DIM, 0.35 * ENV_DIM, 0.05 * ENV_DIM, 0.65 * ENV_DIM);
-		walls[2].init(0.05 * ENV_DIM, 0.75 * ENV_DIM, 0.05 * ENV_DIM, 0.95 * ENV_DIM);
-
-		walls[3].init(0.95 * ENV_DIM, 0.05 * ENV_DIM, 0.95 * ENV_DIM, 0.25 * ENV_DIM);
-		walls[4].init(0.95 * ENV_DIM, 0.35 * ENV_DIM, 0.95 * ENV_DIM, 0.65 * ENV_DIM);
-		walls[5].init(0.95 * ENV_DIM, 0.75 * ENV_DIM, 0.95 * ENV_DIM, 0.95 * ENV_DIM);
-
-		walls[6].init(0.05 * ENV_DIM, 0.05 * ENV_DIM, 0.25 * ENV_DIM, 0.05 * ENV_DIM);
-		walls[7].init(0.35 * ENV_DIM, 0.05 * ENV_DIM, 0.65 * ENV_DIM, 0.05 * ENV_DIM);
-		walls[8].init(0.75 * ENV_DIM, 0.05 * ENV_DIM, 0.95 * ENV_DIM, 0.05 * ENV_DIM);
-
-		walls[9].init(0.05 * ENV_DIM, 0.95 * ENV_DIM, 0.25 * ENV_DIM, 0.95 * ENV_DIM);
-		walls[10].init(0.35 * ENV_DIM, 0.95 * ENV_DIM, 0.65 * ENV_DIM, 0.95 * ENV_DIM);
-		walls[11].init(0.75 * ENV_DIM, 0.95 * ENV_DIM, 0.95 * ENV_DIM, 0.95 * ENV_DIM);
-
-		for (int i = 0; i < NUM_PARAM; i++) {
+		scene = sceneHost;
+		gateMask = 0;
+		for (int i = 0; i < NUM_PARAM; i++)
 			if (cloneParams[i] == 1)
-				gates[i] = globalGates[i];
-			else
-				gates[i].init(0, 0, 0, 0);
-		}
+				gateMask |= 1ULL << i;
 
 		util::hostAllocCopyToDevice<SocialForceClone>(this, &this->selfDev);
 	}
+	__host__ __device__ bool gateClosed(int i) const {
+		return (gateMask >> i) & 1ULL;
+	}
 	void step(int stepCount);
 	void alterGate(int stepCount);
 	void swap();
@@ -382,6 +402,7 @@ public:
 	int *globalParams;
 	int *globalParents;
 	vector<vector<int>> cloningTree;
+	SceneGeometry scene;
 
 	void performClone(SocialForceClone *parentClone, SocialForceClone *childClone);
 	void compareAndEliminate(SocialForceClone *parentClone, SocialForceClone *childClone);
@@ -432,6 +453,8 @@ public:
 			globalGates[4 * i + 2].init((x - dx), (y - dy), (x + dx), (y - dy));
 			globalGates[4 * i + 3].init((x - dx), (y + dy), (x + dx), (y + dy));
 		}
+		scene.init(globalGates);
+		cudaMemcpyToSymbol(sceneDev, &scene, sizeof(SceneGeometry));
 
 		globalParams = new int[totalClone];
 		globalParents = new int[totalClone];
@@ -478,7 +501,7 @@ public:
 			}
 
 			cudaMallocHost((void**)&cAll[i], sizeof(SocialForceClone));
-			cAll[i]->init(i, cloneParams, globalGates);
+			cAll[i]->init(i, cloneParams, &scene);
 		}
 
 #if USE_CLONE == 1
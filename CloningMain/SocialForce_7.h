@@ -1,5 +1,6 @@
 #include <vector>
 #include <math.h>
+#include <assert.h>
 #include <ctime>
 #include <Windows.h>
 #include <algorithm>
@@ -7,13 +8,27 @@
 #include <iomanip>
 #include <iostream>
 #include "inc\helper_math.h"
+#include "gsimrandom.h"
+#include "gsimboundary.h"
+#include "CloneTransport.h"
+#include "SimConfig.h"
 #include <random>
+#include <emmintrin.h>
+#include <new>
+#include <thread>
+#include <omp.h>
 
 /* FOCUS: test GPU neighbor searching strategy on CPU */
 
 using namespace std;
 
+// the room has walls and the cell lists below stop at its edge, it cannot be a torus
+#if GWORLD_BOUNDARY == BOUNDARY_PERIODIC
+#error SocialForce_7.h supports BOUNDARY_CLAMP and BOUNDARY_REFLECT only
+#endif
+
 ofstream fout1;
+ofstream foutCost;
 int g_stepCount = 0;
 
 #define DIST(ax, ay, bx, by) sqrt((ax-bx)*(ax-bx)+(ay-by)*(ay-by))
@@ -130,33 +145,278 @@ inline double2 operator-(const double2& a, const double2& b)
 #define k2 (2.4 * 100000) 
 #define	maxv 3
 
-#define NUM_CAP 128
+/* the model dimensions come from g_config (SimConfig.h, loaded by initSimClone), NUM_PARAM and
+NUM_WALLS size the gate and wall arrays of a clone and stay constants */
+#define NUM_CAP g_config.numCap
 #define NUM_PARAM 3
 #define NUM_STEP 500
 #define NUM_GOAL 3
-#define ENV_DIM 128
-#define NUM_CELL 8
-#define CELL_DIM 16
-#define RADIUS_I 6
+#define ENV_DIM g_config.envDim
+#define NUM_CELL g_config.numCell
+#define CELL_DIM g_config.cellDim
+#define RADIUS_I g_config.radiusI
 
 #define NUM_WALLS 10
+#define WALL_GRID_DIM 32
+#define WALL_CUTOFF RADIUS_I
+
+#define VERLET_SKIN 2.0
+#define VERLET_CAP 64 // entries of a Verlet list, a denser neighborhood falls back to the full context scan
+#define VERLET_RANGE (g_cutoff + VERLET_SKIN)
+
+#define AGENT_MASS 50
+#define FORCE_TOLERANCE (g_config.toleranceExp > 0 ? pow(10.0, -g_config.toleranceExp) : 0)
+#define CUTOFF_VALIDATION 0
+#define PRECISION_MODE 0
+#define FIXED_POINT_STATE 0
+#define FIXED_FRAC_BITS 32
+#define STEP_CHUNK 32 // agents per work item of the parallel agent loop
+#define PARALLEL_STEP_MIN (2 * STEP_CHUNK) // smaller clones step on the calling thread
+#define COST_EMA 0.5 // weight of the newest measurement in the clone cost model
+#define NUMA_PLACEMENT 0 // 1: clone subtrees get node-local arenas and workers pinned to the node
+#define CHECKPOINT_INTERVAL 50 // steps between the checkpoints of a worker process
+#define RESIDENT_CLONES 0 // clones kept in memory, colder ones are spilled to disk, 0: all resident
+#define HOLD_RESIDENT // the app has holdResident, the dialog calls it for the clone it draws
+#define NUM_REPLICA 1 // copies of the clone tree stepped in one pass, each from its own seed
+#define REPLICA_SEED 1000 // replica r > 0 places its agents from seed REPLICA_SEED + r
+#define SIM_CONFIG_FILE "../TestVisual2/sim.cfg"
+
+/* NUM_CAP size classes with precompiled kernels: in kernel<Cap> the agent loops fold to
+constants. Other capacities run kernel<0>, which reads NUM_CAP */
+#define CAP_DISPATCH(kernel) \
+	switch (NUM_CAP) { \
+	case 128: kernel<128>(); break; \
+	case 256: kernel<256>(); break; \
+	case 512: kernel<512>(); break; \
+	case 1024: kernel<1024>(); break; \
+	default: kernel<0>(); break; \
+	}
+
+SimConfig g_config;
+
+/* interaction cutoffs derived from the force model: beyond them A * exp(dDelta / B) is below
+FORCE_TOLERANCE and the k1 / k2 contact terms are zero (cMass is 100). The tolerance is opt-in
+(FORCE_TOLERANCE_EXP in sim.cfg), without it the radii are RADIUS_I and WALL_CUTOFF and the
+passive cloning map has the NUM_CELL grid. With it the map uses cells no smaller than g_cutoff,
+set up by setInteractionCutoff before the clones are created */
+double g_cutoff = RADIUS_I;
+double g_wallCutoff = WALL_CUTOFF;
+int g_takenCellNum = NUM_CELL;
+double g_takenCellDim = CELL_DIM;
+double g_cutoffMaxErr = 0;
+#define TAKEN_CELL_NUM g_takenCellNum
+
+void setInteractionCutoff(double maxMass) {
+	g_cutoff = RADIUS_I;
+	g_wallCutoff = WALL_CUTOFF;
+	g_takenCellNum = NUM_CELL;
+	g_takenCellDim = CELL_DIM;
+	if (FORCE_TOLERANCE > 0) {
+		double decay = B * log(A / FORCE_TOLERANCE);
+		g_cutoff = min(g_cutoff, 2 * maxMass / 100 + decay);
+		g_wallCutoff = min(g_wallCutoff, maxMass / 100 + decay);
+		g_takenCellNum = max(1, (int)(ENV_DIM / g_cutoff));
+		g_takenCellDim = (double)ENV_DIM / g_takenCellNum;
+	}
+#if CUTOFF_VALIDATION == 1
+	wchar_t message[128];
+	swprintf_s(message, 128, L"cutoff %f, wall cutoff %f, passive cells %d\n", g_cutoff, g_wallCutoff, g_takenCellNum);
+	OutputDebugString(message);
+#endif
+}
+
+/* precision policies of the agent state and the force kernels: Store is what the agent data 
+keeps, Calc what the kernels evaluate in, Accum what forces are summed in. Wall geometry stays 
+in double. PRECISION_MODE 0: double, 1: float, 2: float with double force accumulation */
+struct PrecisionDouble {
+	typedef double Store;	typedef double2 Store2;
+	typedef double Calc;	typedef double2 Calc2;
+	typedef double Accum;	typedef double2 Accum2;
+};
+struct PrecisionFloat {
+	typedef float Store;	typedef float2 Store2;
+	typedef float Calc;		typedef float2 Calc2;
+	typedef float Accum;	typedef float2 Accum2;
+};
+struct PrecisionMixed {
+	typedef float Store;	typedef float2 Store2;
+	typedef float Calc;		typedef float2 Calc2;
+	typedef double Accum;	typedef double2 Accum2;
+};
+#if PRECISION_MODE == 1
+typedef PrecisionFloat Precision;
+#elif PRECISION_MODE == 2
+typedef PrecisionMixed Precision;
+#else
+typedef PrecisionDouble Precision;
+#endif
+typedef Precision::Store real_store;
+typedef Precision::Store2 real2_store;
+typedef Precision::Calc real_calc;
+typedef Precision::Calc2 real2_calc;
+typedef Precision::Accum real_accum;
+typedef Precision::Accum2 real2_accum;
+
+template<class T2>
+inline T2 make2(double x, double y) {
+	T2 r;
+	r.x = x;
+	r.y = y;
+	return r;
+}
+template<class T2, class S2>
+inline T2 cast2(const S2 &v) {
+	return make2<T2>(v.x, v.y);
+}
+
+/* fixed point agent state: with FIXED_POINT_STATE 1 the location and velocity an agent ends a step
+with are rounded to a 32.32 (FIXED_FRAC_BITS) grid and kept as integers next to dataCopy, and pair
+forces are summed as integers. Integer sums are associative, so the result does not depend on the
+order pair forces arrive in, and clone elimination compares the packed integers instead of doubles */
+typedef long long fixed_t;
+#define FIXED_ONE ((double)(1LL << FIXED_FRAC_BITS))
+inline fixed_t toFixed(double v) {
+	return (fixed_t)floor(v * FIXED_ONE + 0.5);
+}
+inline double fromFixed(fixed_t v) {
+	return v / FIXED_ONE;
+}
+typedef struct {
+	fixed_t lx, ly, vx, vy;
+} FixedState;
+inline bool fixedEqual(const FixedState &a, const FixedState &b) {
+	__m128i loc = _mm_xor_si128(_mm_loadu_si128((const __m128i*)&a.lx), _mm_loadu_si128((const __m128i*)&b.lx));
+	__m128i vel = _mm_xor_si128(_mm_loadu_si128((const __m128i*)&a.vx), _mm_loadu_si128((const __m128i*)&b.vx));
+	__m128i diff = _mm_or_si128(loc, vel);
+	return _mm_movemask_epi8(_mm_cmpeq_epi8(diff, _mm_setzero_si128())) == 0xFFFF;
+}
+class ForceSum {
+#if FIXED_POINT_STATE == 1
+	fixed_t x, y;
+public:
+	ForceSum() : x(0), y(0) {}
+	inline void add(const real2_accum &f) { x += toFixed(f.x); y += toFixed(f.y); }
+	inline void get(real2_accum &f) const { f.x = fromFixed(x); f.y = fromFixed(y); }
+#else
+	real2_accum sum;
+public:
+	ForceSum() { sum.x = 0; sum.y = 0; }
+	inline void add(const real2_accum &f) { sum.x += f.x; sum.y += f.y; }
+	inline void get(real2_accum &f) const { f = sum; }
+#endif
+};
 
 default_random_engine randGen;
+// seed of the initial agent locations of a replica, replica 0 is the plain run. RANDOM_SEED
+// of the config replaces both
+inline unsigned replicaSeed(int replica) {
+	if (g_config.randomSeed >= 0)
+		return g_config.randomSeed + replica;
+	return replica == 0 ? default_random_engine::default_seed : REPLICA_SEED + replica;
+}
 uniform_real_distribution<double> distr(0.0, 1.0);
 
 class SocialForceAgent;
 class SocialForceClone;
 
-typedef struct {
-	double2 goal;
-	double2 velocity;
-	double v0;
-	double mass;
+template<class P>
+struct SocialForceAgentDataT {
+	typename P::Store2 goal;
+	typename P::Store2 velocity;
+	typename P::Store v0;
+	typename P::Store mass;
 	int numNeighbor;
-	double2 loc;
+	typename P::Store2 loc;
 	SocialForceAgent *agentPtr;
 	//__device__ void putDataInSmem(GAgent *ag);
-} SocialForceAgentData;
+};
+typedef SocialForceAgentDataT<Precision> SocialForceAgentData;
+
+template<class P>
+inline void socialForcePair(const SocialForceAgentDataT<P> &myData, const SocialForceAgentDataT<P> &otherData, typename P::Accum2 &fSum) {
+	typedef typename P::Calc real;
+	real cMass = 100;
+	//my data
+	real x = myData.loc.x, y = myData.loc.y;
+	real vx = myData.velocity.x, vy = myData.velocity.y;
+	real mass = myData.mass;
+	//other's data
+	real xOther = otherData.loc.x, yOther = otherData.loc.y;
+	real vxOther = otherData.velocity.x, vyOther = otherData.velocity.y;
+	real massOther = otherData.mass;
+
+	real d = (real)1e-15 + sqrt((x - xOther) * (x - xOther) + (y - yOther) * (y - yOther));
+	real dDelta = mass / cMass + massOther / cMass - d;
+	real fExp = (real)A * exp(dDelta / (real)B);
+	real fKg = dDelta < 0 ? (real)0 : (real)k1 * dDelta;
+	real nijx = (x - xOther) / d;
+	real nijy = (y - yOther) / d;
+	real fnijx = (fExp + fKg) * nijx;
+	real fnijy = (fExp + fKg) * nijy;
+	real fkgx = 0;
+	real fkgy = 0;
+	if (dDelta > 0) {
+		real tix = -nijy;
+		real tiy = nijx;
+		fkgx = (real)k2 * dDelta;
+		fkgy = (real)k2 * dDelta;
+		real vijDelta = (vxOther - vx) * tix + (vyOther - vy) * tiy;
+		fkgx = fkgx * vijDelta * tix;
+		fkgy = fkgy * vijDelta * tiy;
+	}
+	fSum.x += fnijx + fkgx;
+	fSum.y += fnijy + fkgy;
+}
+
+template<class P>
+inline void wallForce(const SocialForceAgentDataT<P> &dataLocal, obstacleLine &wall, const int &cMass, const double &cutoff, typename P::Accum2 &fSum) {
+	typedef typename P::Calc real;
+	double2 loc = cast2<double2>(dataLocal.loc);
+
+	double2 wl = make_double2(wall.ex - wall.sx, wall.ey - wall.sy);
+	if (length(wl) == 0) return;
+	double diw, crx, cry;
+
+	diw = wall.pointToLineDist(loc, crx, cry, 0);
+	if (diw >= cutoff)
+		return;
+	double virDiw = DIST(loc.x, loc.y, crx, cry);
+
+	if (virDiw == 0)
+		return;
+
+	real niwx = (loc.x - crx) / virDiw;
+	real niwy = (loc.y - cry) / virDiw;
+	real drw = dataLocal.mass / cMass - diw;
+
+	real fiw1 = (real)A * exp(drw / (real)B);
+
+	if (drw > 0)
+		fiw1 += (real)k1 * drw;
+	real fniwx = fiw1 * niwx;
+	real fniwy = fiw1 * niwy;
+	real fiwKgx = 0, fiwKgy = 0;
+	if (drw > 0)
+	{
+		real fiwKg = (real)k2 * drw * (dataLocal.velocity.x * (-niwy) + dataLocal.velocity.y * niwx);
+		fiwKgx = fiwKg * (-niwy);
+		fiwKgy = fiwKg * niwx;
+	}
+
+	fSum.x += fniwx - fiwKgx;
+	fSum.y += fniwy - fiwKgy;
+}
+// what a process hands over of an agent: the root snapshot of CloneTransport and checkpoints
+typedef struct {
+	SocialForceAgentData data;
+	SocialForceAgentData dataCopy;
+#if FIXED_POINT_STATE == 1
+	FixedState fixedCopy;
+#endif
+	int contextId;
+	int goalIdx;
+} AgentState;
+
 class SocialForceAgent {
 public:
 	SocialForceClone *myClone;
@@ -164,6 +424,9 @@ public:
 	SocialForceAgent *myOrigin;
 	SocialForceAgentData data;
 	SocialForceAgentData dataCopy;
+#if FIXED_POINT_STATE == 1
+	FixedState fixedCopy;
+#endif
 	double2 goalSeq[NUM_GOAL];
 	int goalIdx = 0;
 
@@ -172,43 +435,195 @@ public:
 	//double gateSize;
 
 	double correctCrossBoader(double val, double limit);
-	void computeIndivSocialForceRoom(const SocialForceAgentData &myData, const SocialForceAgentData &otherData, double2 &fSum);
-	void computeForceWithWall(const SocialForceAgentData &dataLocal, obstacleLine &wall, const int &cMass, double2 &fSum);
-	void computeWallImpaction(const SocialForceAgentData &dataLocal, obstacleLine &wall, const double2 &newVelo, const double &tick, double &mint);
-	void computeDirection(const SocialForceAgentData &dataLocal, double2 &dvt);
-	void computeSocialForceRoom(SocialForceAgentData &dataLocal, double2 &fSum);
-	void chooseNewGoal(const double2 &newLoc, double epsilon, double2 &newGoal);
+	void computeIndivSocialForceRoom(const SocialForceAgentData &myData, const SocialForceAgentData &otherData, real2_accum &fSum);
+	void computeForceWithWall(const SocialForceAgentData &dataLocal, obstacleLine &wall, const int &cMass, const double &cutoff, real2_accum &fSum);
+	void computeWallImpaction(const SocialForceAgentData &dataLocal, obstacleLine &wall, const real2_calc &newVelo, const double &tick, double &mint);
+	void computeDirection(const SocialForceAgentData &dataLocal, real2_calc &dvt);
+	void computeSocialForceRoom(SocialForceAgentData &dataLocal, real2_accum &fSum);
+	void chooseNewGoal(const real2_calc &newLoc, double epsilon, real2_calc &newGoal);
 	void step();
+	void storeFixed(const real2_calc &loc, const real2_calc &velo);
 	void init(SocialForceClone* c, int idx);
 	void initNewClone(SocialForceAgent *agent, SocialForceClone *clone);
+	void saveState(AgentState &state) const;
+	void loadState(const AgentState &state, SocialForceClone *clone);
+};
+/* bump allocator over the committed memory of one clone. With NUMA_PLACEMENT every subtree
+of the clone tree gets a node and its clones are carved out of that node, so only the subtree
+roots read memory of another node (their parent's context). With RESIDENT_CLONES a cold clone
+is spilled: the arena is copied to a file mapping and decommitted, but its address range stays
+reserved, so the pointers other clones hold into it are valid again after pageIn */
+class CloneArena {
+	char *base;
+	size_t size, used;
+	HANDLE file, mapping;
+	bool sizing;
+	vector<void*> heapBlocks;	// allocations of a sizing arena
+public:
+	int node;		// -1: no NUMA node
+	bool resident;
+	int fallbacks;	// allocations that did not fit and went to the process heap
+	CloneArena(int node, size_t size) : size(size), used(0), file(INVALID_HANDLE_VALUE), mapping(NULL),
+		sizing(false), node(node), resident(true), fallbacks(0) {
+		if (node >= 0)
+			base = (char*)VirtualAllocExNuma(GetCurrentProcess(), NULL, size, MEM_RESERVE | MEM_COMMIT, PAGE_READWRITE, node);
+		else
+			base = (char*)VirtualAlloc(NULL, size, MEM_RESERVE | MEM_COMMIT, PAGE_READWRITE);
+		if (base == NULL)
+			this->size = 0;
+	}
+	// a sizing arena takes everything from the heap and only counts it, see SocialForceClone::arenaBytes
+	CloneArena() : base(NULL), size(0), used(0), file(INVALID_HANDLE_VALUE), mapping(NULL),
+		sizing(true), node(-1), resident(true), fallbacks(0) {}
+	~CloneArena() {
+		for (int i = 0; i < heapBlocks.size(); i++)
+			free(heapBlocks[i]);
+	}
+	size_t bytesUsed() const {
+		return used;
+	}
+	void *alloc(size_t bytes) {
+		bytes = (bytes + 63) & ~(size_t)63;
+		if (sizing) {
+			used += bytes;
+			heapBlocks.push_back(malloc(bytes));
+			return heapBlocks.back();
+		}
+		if (used + bytes > size) {
+			// out of node memory, fall back to the process heap: neither node local nor spilled
+			if (fallbacks++ == 0) {
+				char msg[128];
+				sprintf_s(msg, 128, "CloneArena: %Iu of %Iu bytes used, %Iu more go to the heap\n", used, size, bytes);
+				OutputDebugStringA(msg);
+			}
+			return malloc(bytes);
+		}
+		void *p = base + used;
+		used += bytes;
+		return p;
+	}
+	// copies the arena to the file at path and releases its memory, false if it stays resident
+	bool spill(const char *path) {
+		if (!resident || used == 0)
+			return false;
+		if (mapping == NULL) {
+			// the file lives as long as the handles, it is never meant to be read by anyone else
+			file = CreateFileA(path, GENERIC_READ | GENERIC_WRITE, 0, NULL, CREATE_ALWAYS,
+				FILE_ATTRIBUTE_TEMPORARY | FILE_FLAG_DELETE_ON_CLOSE, NULL);
+			if (file == INVALID_HANDLE_VALUE)
+				return false;
+			mapping = CreateFileMappingA(file, NULL, PAGE_READWRITE, (DWORD)((unsigned long long)size >> 32), (DWORD)size, NULL);
+			if (mapping == NULL) {
+				CloseHandle(file);
+				file = INVALID_HANDLE_VALUE;
+				return false;
+			}
+		}
+		void *view = MapViewOfFile(mapping, FILE_MAP_ALL_ACCESS, 0, 0, used);
+		if (view == NULL)
+			return false;
+		memcpy(view, base, used);
+		UnmapViewOfFile(view);
+		VirtualFree(base, size, MEM_DECOMMIT);
+		resident = false;
+		return true;
+	}
+	// recommits the arena at its old address and reads it back
+	bool pageIn() {
+		if (resident)
+			return true;
+		void *p;
+		if (node >= 0)
+			p = VirtualAllocExNuma(GetCurrentProcess(), base, size, MEM_COMMIT, PAGE_READWRITE, node);
+		else
+			p = VirtualAlloc(base, size, MEM_COMMIT, PAGE_READWRITE);
+		void *view = p == NULL ? NULL : MapViewOfFile(mapping, FILE_MAP_ALL_ACCESS, 0, 0, used);
+		if (view == NULL)
+			return false;
+		memcpy(base, view, used);
+		UnmapViewOfFile(view);
+		resident = true;
+		return true;
+	}
 };
+template<class T>
+T *arenaNew(CloneArena *arena, int n) {
+	if (arena == NULL)
+		return new T[n];
+	T *p = (T*)arena->alloc(sizeof(T) * n);
+	for (int i = 0; i < n; i++)
+		new (&p[i]) T();
+	return p;
+}
+inline void pinToNumaNode(int node) {
+	GROUP_AFFINITY affinity;
+	if (GetNumaNodeProcessorMaskEx((USHORT)node, &affinity))
+		SetThreadGroupAffinity(GetCurrentThread(), &affinity, NULL);
+}
+
 class AgentPool {
 public:
 	SocialForceAgent *agentArray;
 	SocialForceAgent **agentPtrArray;
 	bool *takenFlags;
-
-	AgentPool(int numCap) {
-		agentArray = new SocialForceAgent[numCap];
-		agentPtrArray = new SocialForceAgent*[numCap];
-		takenFlags = new bool[numCap];
+	// scratch of reorder
+	SocialForceAgent **agentPtrScratch;
+	int *chunkKept;
+
+	AgentPool(int numCap, CloneArena *arena = NULL) {
+		agentArray = arenaNew<SocialForceAgent>(arena, numCap);
+		agentPtrArray = arenaNew<SocialForceAgent*>(arena, numCap);
+		takenFlags = arenaNew<bool>(arena, numCap);
+		agentPtrScratch = arenaNew<SocialForceAgent*>(arena, numCap);
+		chunkKept = arenaNew<int>(arena, numCap / STEP_CHUNK + 1);
 		for (int i = 0; i < numCap; i++) {
 			agentPtrArray[i] = &agentArray[i];
 			takenFlags[i] = 0;
 		}
 	}
 
+	/* stable compaction by takenFlags: taken agents move to the front and the others to the
+	back, both keeping their order. Chunks count their taken agents, an exclusive prefix sum
+	gives every chunk its two write positions, then the chunks scatter in parallel */
 	int reorder(int numElem) {
-		int l = 0; int r = numElem;
-		int i = l, j = l;
-		for (; j < r; j++) {
-			if (takenFlags[j] == true) {
-				swap<SocialForceAgent*>(agentPtrArray, i, j);
-				swap<bool>(takenFlags, i, j);
-				i++;
+		int numChunk = (numElem + STEP_CHUNK - 1) / STEP_CHUNK;
+		bool parallel = numElem >= PARALLEL_STEP_MIN;
+
+#pragma omp parallel for schedule(static, 1) if (parallel)
+		for (int c = 0; c < numChunk; c++) {
+			int end = min((c + 1) * STEP_CHUNK, numElem);
+			int kept = 0;
+			for (int i = c * STEP_CHUNK; i < end; i++)
+				kept += takenFlags[i];
+			chunkKept[c] = kept;
+		}
+
+		int numKept = 0;
+		for (int c = 0; c < numChunk; c++) {
+			int kept = chunkKept[c];
+			chunkKept[c] = numKept;
+			numKept += kept;
+		}
+
+#pragma omp parallel for schedule(static, 1) if (parallel)
+		for (int c = 0; c < numChunk; c++) {
+			int end = min((c + 1) * STEP_CHUNK, numElem);
+			int kept = chunkKept[c];
+			int dropped = numKept + c * STEP_CHUNK - chunkKept[c];
+			for (int i = c * STEP_CHUNK; i < end; i++) {
+				if (takenFlags[i])
+					agentPtrScratch[kept++] = agentPtrArray[i];
+				else
+					agentPtrScratch[dropped++] = agentPtrArray[i];
 			}
 		}
-		return i;
+
+#pragma omp parallel for schedule(static, STEP_CHUNK) if (parallel)
+		for (int i = 0; i < numElem; i++) {
+			agentPtrArray[i] = agentPtrScratch[i];
+			takenFlags[i] = i < numKept;
+		}
+		return numKept;
 	}
 
 	template<class T>
@@ -235,7 +650,7 @@ namespace NeighborModule {
 		return x | (y << 1);
 	}
 
-	int zcode(const double2 &loc) {
+	int zcode(const real2_store &loc) {
 		int ix = loc.x / (ENV_DIM / NUM_CELL);
 		int iy = loc.y / (ENV_DIM / NUM_CELL);
 		return zcode(ix, iy);
@@ -254,7 +669,7 @@ namespace NeighborModule {
 	void quickSortByAgentLoc(SocialForceAgent** agentPtrs, int l, int r) {
 		if (l == r)
 			return;
-		int pi = l + rand() % (r - l);
+		int pi = l + util::randomBits(0, l, g_stepCount, r).x % (r - l);
 		swap(agentPtrs, l, pi);
 		SocialForceAgent* pivot = agentPtrs[l];
 
@@ -287,6 +702,30 @@ namespace NeighborModule {
 	}
 }
 
+/* static wall lookup: for every cell, the indices of walls that may lie within g_wallCutoff
+of a point in that cell. Built once per scenario from the walls of all clones and shared
+read-only, each clone still evaluates the wall coordinates of its own */
+class WallGrid {
+public:
+	int cellWallStart[WALL_GRID_DIM * WALL_GRID_DIM + 1];
+	int *cellWalls;
+
+	WallGrid() {
+		cellWalls = NULL;
+		memset(cellWallStart, 0, sizeof(int) * (WALL_GRID_DIM * WALL_GRID_DIM + 1));
+	}
+
+	void build(SocialForceClone **clones, int numClone);
+
+	inline int cellOf(const real2_store &loc) const {
+		int ix = loc.x / ((double)ENV_DIM / WALL_GRID_DIM);
+		int iy = loc.y / ((double)ENV_DIM / WALL_GRID_DIM);
+		ix = min(max(ix, 0), WALL_GRID_DIM - 1);
+		iy = min(max(iy, 0), WALL_GRID_DIM - 1);
+		return ix * WALL_GRID_DIM + iy;
+	}
+};
+
 class SocialForceClone {
 public:
 	AgentPool *ap;
@@ -298,27 +737,72 @@ public:
 	int cloneParams[NUM_PARAM];
 	obstacleLine walls[NUM_WALLS];
 	obstacleLine gates[NUM_PARAM];
-	bool takenMap[NUM_CELL * NUM_CELL];
+	bool *takenMap;
+	const WallGrid *wallGrid;
+
+	// Verlet lists of the own agents, indexed by contextId, see updateVerletLists
+	int *verletIds;
+	int *verletNum;
+	double *verletBuiltAt;
+	bool *verletStale;
+	double2 *verletLastLoc;
+	double verletTravel;
+	real2_accum *pairForce;
+	bool *pairHit;
+
+	// staging of appendClones, a STEP_CHUNK segment and a count per chunk of the parent
+	int *cloneStage;
+	int *cloneStageNum;
 
 	uchar4 color;
 	uint cloneid;
 	int parentCloneid;
+	int replica;
+
+	// cost model of SocialForceSimApp::predictCost, times in ms
+	double work;		// agents plus neighbor pairs of the last step
+	double costLast;	// measured time of the last proc
+	double costEma;		// moving average of costLast
+	double costPred;
+	double cloneTime;	// time of the last performClone
 
 	fstream fout;
 
-	SocialForceClone(int id, int pv1[NUM_PARAM]) {
+	SocialForceClone(int id, int pv1[NUM_PARAM], CloneArena *arena = NULL) {
 		numElem = 0;
 		cloneid = id;
-		ap = new AgentPool(NUM_CAP);
-		context = new SocialForceAgent*[NUM_CAP];
-		contextSorted = new SocialForceAgent*[NUM_CAP];
-		cidStarts = new int[NUM_CELL * NUM_CELL];
-		cidEnds = new int[NUM_CELL * NUM_CELL];
-		cloneFlag = new bool[NUM_CAP];
+		replica = 0;
+		wallGrid = NULL;
+		work = 0;
+		costLast = 0;
+		costEma = 0;
+		costPred = 0;
+		cloneTime = 0;
+		ap = arena == NULL ? new AgentPool(NUM_CAP) : new (arena->alloc(sizeof(AgentPool))) AgentPool(NUM_CAP, arena);
+		context = arenaNew<SocialForceAgent*>(arena, NUM_CAP);
+		contextSorted = arenaNew<SocialForceAgent*>(arena, NUM_CAP);
+		cidStarts = arenaNew<int>(arena, NUM_CELL * NUM_CELL);
+		cidEnds = arenaNew<int>(arena, NUM_CELL * NUM_CELL);
+		cloneFlag = arenaNew<bool>(arena, NUM_CAP);
+		takenMap = arenaNew<bool>(arena, g_takenCellNum * g_takenCellNum);
+		memset(takenMap, 0, sizeof(bool) * g_takenCellNum * g_takenCellNum);
+		verletIds = arenaNew<int>(arena, NUM_CAP * VERLET_CAP);
+		verletNum = arenaNew<int>(arena, NUM_CAP);
+		verletBuiltAt = arenaNew<double>(arena, NUM_CAP);
+		verletStale = arenaNew<bool>(arena, NUM_CAP);
+		verletLastLoc = arenaNew<double2>(arena, NUM_CAP);
+		verletTravel = 0;
+		pairForce = arenaNew<real2_accum>(arena, NUM_CAP * VERLET_CAP);
+		pairHit = arenaNew<bool>(arena, NUM_CAP * VERLET_CAP);
+		cloneStage = arenaNew<int>(arena, NUM_CAP);
+		cloneStageNum = arenaNew<int>(arena, NUM_CAP / STEP_CHUNK + 1);
+		memset(verletLastLoc, 0, sizeof(double2) * NUM_CAP);
+		memset(verletStale, 1, sizeof(bool) * NUM_CAP);
 		memset(context, 0, sizeof(void*) * NUM_CAP);
 		memset(contextSorted, 0, sizeof(void*) * NUM_CAP);
 		memset(cloneFlag, 0, sizeof(bool) * NUM_CAP);
-		color.x = rand() % 255; color.y = rand() % 255; color.z = rand() % 255;
+		uint4 bits = util::randomBits(0, id, 0, 0);
+		color.x = bits.x % 255; color.y = bits.y % 255; color.z = bits.z % 255;
 
 		memcpy(cloneParams, pv1, sizeof(int) * NUM_PARAM);
 
@@ -342,9 +826,69 @@ public:
 		gates[2].init(0.5 * ENV_DIM, 0.3 * ENV_DIM - cloneParams[2], 0.5 * ENV_DIM, 0.3 * ENV_DIM + cloneParams[2]);
 
 
+	}
+	/* the arena memory one clone takes: a clone is built once on a sizing arena, so the size
+	follows every arenaNew of this constructor and of AgentPool at the current NUM_CAP */
+	static size_t arenaBytes() {
+		CloneArena probe;
+		int pv[NUM_PARAM] = { 0 };
+		SocialForceClone clone(0, pv, &probe);
+		return probe.bytesUsed();
 	}
 	void step(int stepCount);
+	void updateWork() {
+		int numNeighbor = 0;
+		for (int i = 0; i < numElem; i++)
+			numNeighbor += ap->agentPtrArray[i]->data.numNeighbor;
+		work = numElem + numNeighbor;
+	}
 	void alterGate(int stepCount);
+	template<int Cap> void buildVerletList(int ctx);
+	void updateVerletLists();
+	template<int Cap> void updateVerletListsCap();
+	void computePairForces();
+	template<int Cap> void computePairForcesCap();
+	/* appends a clone of every agent of source that passes cond. Chunks of the parent are checked
+	in parallel and stage the indices they pick, an exclusive prefix sum over the chunk counts
+	then places every chunk in the pool, so the order is the parent order at any thread count */
+	template<class Cond>
+	void appendClones(SocialForceAgent **source, int numParent, Cond cond) {
+		int numChunk = (numParent + STEP_CHUNK - 1) / STEP_CHUNK;
+		bool parallel = numParent >= PARALLEL_STEP_MIN;
+
+#pragma omp parallel for schedule(static, 1) if (parallel)
+		for (int c = 0; c < numChunk; c++) {
+			int begin = c * STEP_CHUNK;
+			int end = min(begin + STEP_CHUNK, numParent);
+			int num = 0;
+			for (int i = begin; i < end; i++)
+				if (cond(source[i]))
+					cloneStage[begin + num++] = i;
+			cloneStageNum[c] = num;
+		}
+
+		int offset = numElem;
+		for (int c = 0; c < numChunk; c++) {
+			int num = cloneStageNum[c];
+			cloneStageNum[c] = offset;
+			offset += num;
+		}
+		cloneStageNum[numChunk] = offset;
+
+#pragma omp parallel for schedule(static, 1) if (parallel)
+		for (int c = 0; c < numChunk; c++) {
+			const int *picked = &cloneStage[c * STEP_CHUNK];
+			for (int slot = cloneStageNum[c]; slot < cloneStageNum[c + 1]; slot++) {
+				SocialForceAgent *agent = source[*picked++];
+				SocialForceAgent &childAgent = *ap->agentPtrArray[slot];
+				ap->takenFlags[slot] = true;
+				childAgent.initNewClone(agent, this);
+				context[childAgent.contextId] = &childAgent;
+				cloneFlag[childAgent.contextId] = true;
+			}
+		}
+		numElem = offset;
+	}
 	void swap() {
 		for (int i = 0; i < numElem; i++) {
 			SocialForceAgent &agent = *ap->agentPtrArray[i];
@@ -353,7 +897,10 @@ public:
 	}
 	void output(int stepCount, char *s) {
 		char filename[128];
-		sprintf_s(filename, 128, "clone%d_%s.txt", cloneid, s);
+		if (replica > 0)
+			sprintf_s(filename, 128, "clone%d_r%d_%s.txt", cloneid, replica, s);
+		else
+			sprintf_s(filename, 128, "clone%d_%s.txt", cloneid, s);
 		if (stepCount == 1)
 			fout.open(filename, fstream::out);
 		else
@@ -387,90 +934,155 @@ public:
 		fout.close();
 	}
 };
-double SocialForceAgent::correctCrossBoader(double val, double limit)
-{
-	if (val >= limit)
-		return limit - 0.001;
-	else if (val < 0)
-		return 0;
-	return val;
+void WallGrid::build(SocialForceClone **clones, int numClone) {
+	double cellDim = (double)ENV_DIM / WALL_GRID_DIM;
+	double reach = g_wallCutoff + cellDim * 0.7072; // cutoff + half of the cell diagonal
+	vector<int> entries;
+
+	for (int cid = 0; cid < WALL_GRID_DIM * WALL_GRID_DIM; cid++) {
+		cellWallStart[cid] = entries.size();
+		double2 center = make_double2(
+			(cid / WALL_GRID_DIM + 0.5) * cellDim,
+			(cid % WALL_GRID_DIM + 0.5) * cellDim);
+		for (int i = 0; i < NUM_WALLS; i++) {
+			for (int c = 0; c < numClone; c++) {
+				obstacleLine wall = clones[c]->walls[i];
+				if (wall.pointToLineDist(center) <= reach) {
+					entries.push_back(i);
+					break;
+				}
+			}
+		}
+	}
+	cellWallStart[WALL_GRID_DIM * WALL_GRID_DIM] = entries.size();
+
+	delete[] cellWalls;
+	cellWalls = new int[entries.size() + 1];
+	for (int i = 0; i < entries.size(); i++)
+		cellWalls[i] = entries[i];
 }
-void SocialForceAgent::computeIndivSocialForceRoom(const SocialForceAgentData &myData, const SocialForceAgentData &otherData, double2 &fSum){
-	double cMass = 100;
-	//my data
-	const double2& loc = myData.loc;
-	const double2& goal = myData.goal;
-	const double2& velo = myData.velocity;
-	const double& v0 = myData.v0;
-	const double& mass = myData.mass;
-	//other's data
-	const double2& locOther = otherData.loc;
-	const double2& goalOther = otherData.goal;
-	const double2& veloOther = otherData.velocity;
-	const double& v0Other = otherData.v0;
-	const double& massOther = otherData.mass;
-
-	double d = 1e-15 + sqrt((loc.x - locOther.x) * (loc.x - locOther.x) + (loc.y - locOther.y) * (loc.y - locOther.y));
-	double dDelta = mass / cMass + massOther / cMass - d;
-	double fExp = A * exp(dDelta / B);
-	double fKg = dDelta < 0 ? 0 : k1 *dDelta;
-	double nijx = (loc.x - locOther.x) / d;
-	double nijy = (loc.y - locOther.y) / d;
-	double fnijx = (fExp + fKg) * nijx;
-	double fnijy = (fExp + fKg) * nijy;
-	double fkgx = 0;
-	double fkgy = 0;
-	if (dDelta > 0) {
-		double tix = -nijy;
-		double tiy = nijx;
-		fkgx = k2 * dDelta;
-		fkgy = k2 * dDelta;
-		double vijDelta = (veloOther.x - velo.x) * tix + (veloOther.y - velo.y) * tiy;
-		fkgx = fkgx * vijDelta * tix;
-		fkgy = fkgy * vijDelta * tiy;
+/* Verlet lists: the list of slot i holds, in contextId order, every slot j within VERLET_RANGE
+of it at build time, so the force sum runs in the same order as the full context scan.
+verletTravel adds up the largest per-step move of any context slot, a list stays valid while
+twice the travel since its build is below VERLET_SKIN (0.99 leaves room for the float distance
+test in computeSocialForceRoom) */
+inline bool verletClose(const real2_store &a, const real2_store &b) {
+	return DIST(a.x, a.y, b.x, b.y) < VERLET_RANGE;
+}
+inline bool verletExpired(double travel, double builtAt) {
+	return 2 * (travel - builtAt) >= VERLET_SKIN * 0.99;
+}
+// entry of ci in the sorted list ids, -1 if it is not there
+inline int verletSlot(const int *ids, int num, int ci) {
+	int t = lower_bound(ids, ids + num, ci) - ids;
+	return t < num && ids[t] == ci ? t : -1;
+}
+// Cap stands for NUM_CAP, a list with more than VERLET_CAP entries is marked by num -1
+template<int Cap>
+void SocialForceClone::buildVerletList(int ctx) {
+	const int numCap = Cap > 0 ? Cap : NUM_CAP;
+	const real2_store &loc = context[ctx]->data.loc;
+	int *ids = &verletIds[ctx * VERLET_CAP];
+	int num = 0;
+	for (int j = 0; j < numCap && num >= 0; j++) {
+		if (j == ctx || !verletClose(context[j]->data.loc, loc))
+			continue;
+		if (num == VERLET_CAP)
+			num = -1;
+		else
+			ids[num++] = j;
 	}
-	fSum.x += fnijx + fkgx;
-	fSum.y += fnijy + fkgy;
+	verletNum[ctx] = num;
+	verletBuiltAt[ctx] = verletTravel;
+	verletStale[ctx] = false;
 }
-
-void SocialForceAgent::computeForceWithWall(const SocialForceAgentData &dataLocal, obstacleLine &wall, const int &cMass, double2 &fSum) {
-	const double2 &loc = dataLocal.loc;
-
-	double2 wl = make_double2(wall.ex - wall.sx, wall.ey - wall.sy);
-	if (length(wl) == 0) return;
-	double diw, crx, cry;
-
-	diw = wall.pointToLineDist(loc, crx, cry, this->contextId);
-	double virDiw = DIST(loc.x, loc.y, crx, cry);
-
-	if (virDiw == 0)
-		return;
-
-	double niwx = (loc.x - crx) / virDiw;
-	double niwy = (loc.y - cry) / virDiw;
-	double drw = dataLocal.mass / cMass - diw;
-
-	double fiw1 = A * exp(drw / B);
-
-	if (drw > 0)
-		fiw1 += k1 * drw;
-	double fniwx = fiw1 * niwx;
-	double fniwy = fiw1 * niwy;
-	double fiwKgx = 0, fiwKgy = 0;
-	if (drw > 0)
-	{
-		double fiwKg = k2 * drw * (dataLocal.velocity.x * (-niwy) + dataLocal.velocity.y * niwx);
-		fiwKgx = fiwKg * (-niwy);
-		fiwKgy = fiwKg * niwx;
+void SocialForceClone::updateVerletLists() {
+	CAP_DISPATCH(updateVerletListsCap);
+}
+template<int Cap>
+void SocialForceClone::updateVerletListsCap() {
+	const int numCap = Cap > 0 ? Cap : NUM_CAP;
+	double maxMove = 0;
+	for (int j = 0; j < numCap; j++) {
+		const real2_store &loc = context[j]->data.loc;
+		double move = DIST(loc.x, loc.y, verletLastLoc[j].x, verletLastLoc[j].y);
+		if (move > VERLET_SKIN / 4) {
+			// the slot jumped, e.g. a clone overlay put a diverged agent in it,
+			// only lists of own agents near its new location can miss it
+			for (int i = 0; i < numElem; i++) {
+				SocialForceAgent *agent = ap->agentPtrArray[i];
+				if (verletClose(agent->data.loc, loc))
+					verletStale[agent->contextId] = true;
+			}
+		}
+		else if (move > maxMove)
+			maxMove = move;
+		verletLastLoc[j] = cast2<double2>(loc);
 	}
+	verletTravel += maxMove;
+}
+/* social forces of the own agents, stored per list entry. A pair of own agents is evaluated
+once, from the lower contextId, and the partner gets the negated force, which is bitwise what
+it would compute itself. Partners from the parent context are read-only and only evaluated
+from the own side. Within the cutoff the skin keeps a pair in both lists, should it be missing
+from one, each side evaluates the pair from its own list */
+void SocialForceClone::computePairForces() {
+	CAP_DISPATCH(computePairForcesCap);
+}
+template<int Cap>
+void SocialForceClone::computePairForcesCap() {
+#pragma omp parallel for schedule(static, STEP_CHUNK) if (numElem >= PARALLEL_STEP_MIN)
+	for (int i = 0; i < numElem; i++) {
+		int ci = ap->agentPtrArray[i]->contextId;
+		if (verletStale[ci] || verletExpired(verletTravel, verletBuiltAt[ci]))
+			buildVerletList<Cap>(ci);
+		if (verletNum[ci] > 0)
+			memset(&pairHit[ci * VERLET_CAP], 0, sizeof(bool) * verletNum[ci]);
+	}
+
+	// every slot is written by exactly one agent: its own, or the lower partner of an own pair
+#pragma omp parallel for schedule(guided, STEP_CHUNK) if (numElem >= PARALLEL_STEP_MIN)
+	for (int i = 0; i < numElem; i++) {
+		SocialForceAgent *agent = ap->agentPtrArray[i];
+		int ci = agent->contextId;
+		const int *ids = &verletIds[ci * VERLET_CAP];
+		for (int s = 0; s < verletNum[ci]; s++) {
+			int cj = ids[s];
+			SocialForceAgent *other = context[cj];
+			double ds = length(other->data.loc - agent->data.loc);
+			if (!(ds < g_cutoff && ds > 0))
+				continue;
+			// within the cutoff both lists hold the pair, lists built at other times may differ beyond it
+			bool pairOwned = other->myClone == this && verletNum[cj] >= 0;
+			int t = pairOwned ? verletSlot(&verletIds[cj * VERLET_CAP], verletNum[cj], ci) : -1;
+			assert(!pairOwned || t >= 0);
+			if (t >= 0 && cj < ci)
+				continue;
+			real2_accum &f = pairForce[ci * VERLET_CAP + s];
+			f.x = 0; f.y = 0;
+			agent->computeIndivSocialForceRoom(agent->data, other->data, f);
+			pairHit[ci * VERLET_CAP + s] = true;
+			if (t >= 0) {
+				pairForce[cj * VERLET_CAP + t] = make2<real2_accum>(-f.x, -f.y);
+				pairHit[cj * VERLET_CAP + t] = true;
+			}
+		}
+	}
+}
+double SocialForceAgent::correctCrossBoader(double val, double limit)
+{
+	return util::boundPos(val, limit);
+}
+void SocialForceAgent::computeIndivSocialForceRoom(const SocialForceAgentData &myData, const SocialForceAgentData &otherData, real2_accum &fSum){
+	socialForcePair<Precision>(myData, otherData, fSum);
+}
 
-	fSum.x += fniwx - fiwKgx;
-	fSum.y += fniwy - fiwKgy;
-
+void SocialForceAgent::computeForceWithWall(const SocialForceAgentData &dataLocal, obstacleLine &wall, const int &cMass, const double &cutoff, real2_accum &fSum) {
+	wallForce<Precision>(dataLocal, wall, cMass, cutoff, fSum);
 }
-void SocialForceAgent::computeWallImpaction(const SocialForceAgentData &dataLocal, obstacleLine &wall, const double2 &newVelo, const double &tick, double &mint){
+void SocialForceAgent::computeWallImpaction(const SocialForceAgentData &dataLocal, obstacleLine &wall, const real2_calc &newVelo, const double &tick, double &mint){
 	double crx, cry, tt;
-	const double2 &loc = dataLocal.loc;
+	const real2_store &loc = dataLocal.loc;
 	int ret = wall.intersection2LineSeg(
 		loc.x,
 		loc.y,
@@ -489,24 +1101,23 @@ void SocialForceAgent::computeWallImpaction(const SocialForceAgentData &dataLoca
 			mint = tt;
 	}
 }
-void SocialForceAgent::computeDirection(const SocialForceAgentData &dataLocal, double2 &dvt) {
+void SocialForceAgent::computeDirection(const SocialForceAgentData &dataLocal, real2_calc &dvt) {
 	//my data
-	const double2& loc = dataLocal.loc;
-	const double2& goal = dataLocal.goal;
-	const double2& velo = dataLocal.velocity;
-	const double& v0 = dataLocal.v0;
-	const double& mass = dataLocal.mass;
+	real2_calc loc = cast2<real2_calc>(dataLocal.loc);
+	real2_calc goal = cast2<real2_calc>(dataLocal.goal);
+	real2_calc velo = cast2<real2_calc>(dataLocal.velocity);
+	real_calc v0 = dataLocal.v0;
 
 	dvt.x = 0;	dvt.y = 0;
-	double2 diff; diff.x = 0; diff.y = 0;
-	double d0 = sqrt((loc.x - goal.x) * (loc.x - goal.x) + (loc.y - goal.y) * (loc.y - goal.y));
+	real2_calc diff; diff.x = 0; diff.y = 0;
+	real_calc d0 = sqrt((loc.x - goal.x) * (loc.x - goal.x) + (loc.y - goal.y) * (loc.y - goal.y));
 	diff.x = v0 * (goal.x - loc.x) / d0;
 	diff.y = v0 * (goal.y - loc.y) / d0;
-	dvt.x = (diff.x - velo.x) / tao;
-	dvt.y = (diff.y - velo.y) / tao;
+	dvt.x = (diff.x - velo.x) / (real_calc)tao;
+	dvt.y = (diff.y - velo.y) / (real_calc)tao;
 }
-void SocialForceAgent::computeSocialForceRoom(SocialForceAgentData &dataLocal, double2 &fSum) {
-	fSum.x = 0; fSum.y = 0;
+void SocialForceAgent::computeSocialForceRoom(SocialForceAgentData &dataLocal, real2_accum &fSum) {
+	ForceSum sum;
 	double ds = 0;
 
 	int neighborCount = 0;
@@ -538,20 +1149,37 @@ void SocialForceAgent::computeSocialForceRoom(SocialForceAgentData &dataLocal, d
 	}
 	*/
 
-	for (int i = 0; i < NUM_CAP; i++) {
-		SocialForceAgent *other = myClone->context[i];
-		SocialForceAgentData otherData = other->data;
-		ds = length(otherData.loc - dataLocal.loc);
-		if (ds < 6 && ds > 0) {
-			neighborCount++;
-			computeIndivSocialForceRoom(dataLocal, otherData, fSum);
+	if (myClone->verletNum[contextId] >= 0) {
+		// pair forces come from SocialForceClone::computePairForces, summed in list order
+		int base = contextId * VERLET_CAP;
+		int num = myClone->verletNum[contextId];
+		for (int s = 0; s < num; s++) {
+			if (myClone->pairHit[base + s]) {
+				neighborCount++;
+				sum.add(myClone->pairForce[base + s]);
+			}
+		}
+	}
+	else {
+		// my list overflowed VERLET_CAP, scan the whole context
+		for (int i = 0; i < NUM_CAP; i++) {
+			SocialForceAgent *other = myClone->context[i];
+			const SocialForceAgentData &otherData = other->data;
+			ds = length(otherData.loc - dataLocal.loc);
+			if (ds < g_cutoff && ds > 0) {
+				neighborCount++;
+				real2_accum f = make2<real2_accum>(0, 0);
+				computeIndivSocialForceRoom(dataLocal, otherData, f);
+				sum.add(f);
+			}
 		}
 	}
 
+	sum.get(fSum);
 	dataLocal.numNeighbor = neighborCount;
 }
-__device__ void SocialForceAgent::chooseNewGoal(const double2 &newLoc, double epsilon, double2 &newGoal) {
-	double2 oldGoal = newGoal;
+__device__ void SocialForceAgent::chooseNewGoal(const real2_calc &newLoc, double epsilon, real2_calc &newGoal) {
+	real2_calc oldGoal = newGoal;
 	double2 center = make_double2(ENV_DIM / 2, ENV_DIM / 2);
 	if (newLoc.x < center.x && newLoc.y <= center.y) {
 		//if ((newLoc.x + epsilon >= 0.5 * ENV_DIM))	{
@@ -579,41 +1207,55 @@ __device__ void SocialForceAgent::chooseNewGoal(const double2 &newLoc, double ep
 void SocialForceAgent::step(){
 	double cMass = 100;
 
-	const double2& loc = data.loc;
-	const double2& goal = data.goal;
-	const double2& velo = data.velocity;
-	const double& v0 = data.v0;
-	const double& mass = data.mass;
+	const real2_store& goal = data.goal;
+	real_calc mass = data.mass;
 
 	//compute the direction
-	double2 dvt;
+	real2_calc dvt;
 	computeDirection(data, dvt);
 
 	//compute force with other agents
-	double2 fSum;
+	real2_accum fSum;
 	computeSocialForceRoom(data, fSum);
 
-	//compute force with walls and gates
-	for (int i = 0; i < NUM_WALLS; i++) {
-		if (i == 9 && g_stepCount == 1 && this->contextId == 51) {
-			cout << "";
-		}
-		obstacleLine wall = myClone->walls[i];
-		computeForceWithWall(data, wall, cMass, fSum);
+	//compute force with walls and gates, only the walls listed for my cell can reach me
+	const WallGrid &wallGrid = *myClone->wallGrid;
+	int wallCell = wallGrid.cellOf(data.loc);
+	int wallStart = wallGrid.cellWallStart[wallCell];
+	int wallEnd = wallGrid.cellWallStart[wallCell + 1];
+	for (int i = wallStart; i < wallEnd; i++) {
+		obstacleLine wall = myClone->walls[wallGrid.cellWalls[i]];
+		computeForceWithWall(data, wall, cMass, g_wallCutoff, fSum);
 	}
 
+#if CUTOFF_VALIDATION == 1
+	// compare with the force without any cutoff
+	real2_accum fRef = make2<real2_accum>(0, 0);
+	for (int i = 0; i < NUM_CAP; i++) {
+		const SocialForceAgentData &otherData = myClone->context[i]->data;
+		if (length(otherData.loc - data.loc) > 0)
+			computeIndivSocialForceRoom(data, otherData, fRef);
+	}
+	for (int i = 0; i < NUM_WALLS; i++)
+		computeForceWithWall(data, myClone->walls[i], cMass, 2 * ENV_DIM, fRef);
+	double cutoffErr = DIST(fSum.x, fSum.y, fRef.x, fRef.y);
+#pragma omp critical (cutoffMaxErr)
+	if (cutoffErr > g_cutoffMaxErr)
+		g_cutoffMaxErr = cutoffErr;
+#endif
+
 	//sum up
 	dvt.x += fSum.x / mass;
 	dvt.y += fSum.y / mass;
 
-	double2 newVelo = data.velocity;
-	double2 newLoc = data.loc;
-	double2 newGoal = data.goal;
+	real2_calc newVelo = cast2<real2_calc>(data.velocity);
+	real2_calc newLoc = cast2<real2_calc>(data.loc);
+	real2_calc newGoal = cast2<real2_calc>(data.goal);
 
-	double tick = 0.1;
+	real_calc tick = 0.1;
 	newVelo.x += dvt.x * tick * (1);// + this->random->gaussian() * 0.1);
 	newVelo.y += dvt.y * tick * (1);// + this->random->gaussian() * 0.1);
-	double dv = sqrt(newVelo.x * newVelo.x + newVelo.y * newVelo.y);
+	real_calc dv = sqrt(newVelo.x * newVelo.x + newVelo.y * newVelo.y);
 
 	if (dv > maxv) {
 		newVelo.x = newVelo.x * maxv / dv;
@@ -621,8 +1263,8 @@ void SocialForceAgent::step(){
 	}
 
 	double mint = 1;
-	for (int i = 0; i < NUM_WALLS; i++) {
-		obstacleLine wall = myClone->walls[i];
+	for (int i = wallStart; i < wallEnd; i++) {
+		obstacleLine wall = myClone->walls[wallGrid.cellWalls[i]];
 		computeWallImpaction(data, wall, newVelo, tick, mint);
 	}
 
@@ -640,9 +1282,22 @@ void SocialForceAgent::step(){
 
 	dataCopy = data;
 
-	dataCopy.loc = newLoc;
-	dataCopy.velocity = newVelo;
-	dataCopy.goal = newGoal;
+	dataCopy.loc = cast2<real2_store>(newLoc);
+	dataCopy.velocity = cast2<real2_store>(newVelo);
+	dataCopy.goal = cast2<real2_store>(newGoal);
+#if FIXED_POINT_STATE == 1
+	storeFixed(newLoc, newVelo);
+#endif
+}
+void SocialForceAgent::storeFixed(const real2_calc &loc, const real2_calc &velo) {
+#if FIXED_POINT_STATE == 1
+	fixedCopy.lx = toFixed(loc.x);
+	fixedCopy.ly = toFixed(loc.y);
+	fixedCopy.vx = toFixed(velo.x);
+	fixedCopy.vy = toFixed(velo.y);
+	dataCopy.loc = make2<real2_store>(fromFixed(fixedCopy.lx), fromFixed(fixedCopy.ly));
+	dataCopy.velocity = make2<real2_store>(fromFixed(fixedCopy.vx), fromFixed(fixedCopy.vy));
+#endif
 }
 void SocialForceAgent::init(SocialForceClone *c, int idx) {
 	this->contextId = idx;
@@ -650,9 +1305,10 @@ void SocialForceAgent::init(SocialForceClone *c, int idx) {
 	this->myClone = c;
 	this->myOrigin = NULL;
 
-	this->color.x = rand() % 255;
-	this->color.y = rand() % 255;
-	this->color.z = rand() % 255;
+	uint4 bits = util::randomBits(0, idx, 0, 0);
+	this->color.x = bits.x % 255;
+	this->color.y = bits.y % 255;
+	this->color.z = bits.z % 255;
 
 	this->color.x = 0;
 	this->color.y = 0;
@@ -666,11 +1322,15 @@ void SocialForceAgent::init(SocialForceClone *c, int idx) {
 	dataLocal.velocity.y = 2;//4 * (this->random->uniform()-0.5);
 
 	dataLocal.v0 = 2;
-	dataLocal.mass = 50;
+	dataLocal.mass = AGENT_MASS;
 	dataLocal.numNeighbor = 0;
 
-	dataLocal.goal = make_double2(0.5 * ENV_DIM, 0.7 * ENV_DIM);
+	dataLocal.goal = make2<real2_store>(0.5 * ENV_DIM, 0.7 * ENV_DIM);
 	this->dataCopy = dataLocal;
+#if FIXED_POINT_STATE == 1
+	storeFixed(cast2<real2_calc>(dataLocal.loc), cast2<real2_calc>(dataLocal.velocity));
+	dataLocal = this->dataCopy;
+#endif
 }
 void SocialForceAgent::initNewClone(SocialForceAgent *parent, SocialForceClone *childClone) {
 	this->color = childClone->color;
@@ -681,10 +1341,40 @@ void SocialForceAgent::initNewClone(SocialForceAgent *parent, SocialForceClone *
 
 	this->data = parent->data;
 	this->dataCopy = parent->dataCopy;
+#if FIXED_POINT_STATE == 1
+	this->fixedCopy = parent->fixedCopy;
+#endif
 
 	this->data.agentPtr = this;
 }
+void SocialForceAgent::saveState(AgentState &state) const {
+	state.data = data;
+	state.dataCopy = dataCopy;
+#if FIXED_POINT_STATE == 1
+	state.fixedCopy = fixedCopy;
+#endif
+	state.contextId = contextId;
+	state.goalIdx = goalIdx;
+}
+void SocialForceAgent::loadState(const AgentState &state, SocialForceClone *clone) {
+	this->myClone = clone;
+	this->color = clone->color;
+	this->data = state.data;
+	this->dataCopy = state.dataCopy;
+#if FIXED_POINT_STATE == 1
+	this->fixedCopy = state.fixedCopy;
+#endif
+	this->contextId = state.contextId;
+	this->goalIdx = state.goalIdx;
+	this->data.agentPtr = this;
+	this->dataCopy.agentPtr = this;
+}
 void SocialForceClone::step(int stepCount) {
+	updateVerletLists();
+	computePairForces();
+	// agents only write their own dataCopy, so the chunks are independent and the result
+	// does not depend on the thread count
+#pragma omp parallel for schedule(guided, STEP_CHUNK) if (numElem >= PARALLEL_STEP_MIN)
 	for (int i = 0; i < numElem; i++)
 		ap->agentPtrArray[i]->step();
 }
@@ -702,6 +1392,7 @@ void SocialForceClone::alterGate(int stepCount) {
 class SocialForceSimApp {
 public:
 	SocialForceClone **cAll;
+	WallGrid wallGrid;
 	int paintId = 22;
 	int totalClone = -1;
 	int &stepCount = g_stepCount;
@@ -710,17 +1401,66 @@ public:
 	int *globalParents;
 	vector<vector<int>> cloningTree;
 
+	/* replicas: NUM_REPLICA copies of the clone tree, each seeded by replicaSeed, are stepped
+	in one pass, so a level dispatches the clones of every replica together. Clone c of replica
+	r is cAll[r * totalClone + c], replica 0 is cAll[c] as without replicas. The tree, the wall
+	grid and the worker and NUMA placement are shared: cloneLevel, cloneRank and cloneNode are
+	indexed by tree position, the per clone state by the index into cAll */
+	int numCloneAll = -1;
+	double costPerWork = 0; // ms per unit of SocialForceClone::work, over all clones
+	int *cloneNode;			// NUMA node of every clone, see placeSubtrees
+	int numNode = 1;
+	CloneArena **cloneArena;	// NULL without NUMA_PLACEMENT and RESIDENT_CLONES
+
+	/* out-of-core clones: with RESIDENT_CLONES only that many clones stay in memory. A clone is
+	used at its own level and, through the contexts of its subtree, down to subtreeLastLevel.
+	The levels are swept in the same order every step, so plain LRU would evict exactly the
+	clones needed next. The victim is the clone whose next use is farthest, LRU among equals */
+	int *cloneLevel;
+	int *subtreeLastLevel;
+	int *lastUse;
+	int *processedStep;		// step of the last proc
+	int *swappedStep;		// step of the last swap, a clone spilled before the swap swaps on page in
+	bool *pinned;			// used by the running level or the dialog, not to be spilled
+	int residentCount = 0;
+	int currentLevel = 0;
+	int useClock = 0;
+	int heldId = -1;		// clone shown by the dialog
+
+	int treePos(int g) {
+		return g % totalClone;
+	}
+	int parentOf(int g) {
+		return g - treePos(g) + globalParents[treePos(g)];
+	}
+	int replicaRoot(int r) {
+		return r * totalClone + rootCloneId;
+	}
+	bool isRoot(int g) {
+		return treePos(g) == rootCloneId;
+	}
+
+	/* worker processes: GSIM_WORKERS processes split the subtrees under the root, process
+	GSIM_RANK 0 steps the root and publishes it, the others mirror it from the transport.
+	GSIM_RECOVER=1 restarts a lost worker from its last checkpoint */
+	int workerRank = 0;
+	int numWorkers = 1;
+	int *cloneRank;
+	CloneTransport *transport = NULL;
+	AgentState *rootSnapshot;
+
 	int initSimClone() {
-		srand(0);
+		g_config.load(SIM_CONFIG_FILE);
+		setInteractionCutoff(AGENT_MASS);
 
 		ifstream fin;
 		fin.open("../TestVisual2/exp3CloneTree1.txt", ios::in);
 		fin >> totalClone;
+		numCloneAll = totalClone * NUM_REPLICA;
 
-		fout1.open("exp2.txt", ios::out);
 		StartCounter();
 
-		cAll = new SocialForceClone*[totalClone];
+		cAll = new SocialForceClone*[numCloneAll];
 
 		globalParents = new int[totalClone];
 		for (int i = 1; i < totalClone; i++) {
@@ -741,31 +1481,441 @@ public:
 			cloningTree.push_back(myVec);
 		}
 
-		for (int i = 0; i < totalClone; i++) {
+		bool recover = initWorkers();
+		if (numWorkers > 1) {
+			char name[32];
+			sprintf_s(name, 32, "exp2_%d.txt", workerRank);
+			fout1.open(name, ios::out);
+			sprintf_s(name, 32, "cost_%d.txt", workerRank);
+			foutCost.open(name, ios::out);
+		}
+		else {
+			fout1.open("exp2.txt", ios::out);
+			foutCost.open("cost.txt", ios::out);
+		}
+
+		cloneNode = new int[totalClone];
+		placeSubtrees();
+		initResidency();
+
+#if NUMA_PLACEMENT == 1 || RESIDENT_CLONES > 0
+		size_t arenaBytes = SocialForceClone::arenaBytes();
+#endif
+		for (int g = 0; g < numCloneAll; g++) {
+			int i = treePos(g);
 			int cloneParams[NUM_PARAM];
 			cloneParams[0] = i % 3 + 2;
 			cloneParams[1] = (i / 3) % 3 + 2;
 			cloneParams[2] = (i / 9) % 3 + 2;
-			cAll[i] = new SocialForceClone(i, cloneParams);
+			cloneArena[g] = NULL;
+#if NUMA_PLACEMENT == 1 || RESIDENT_CLONES > 0
+			cloneArena[g] = new CloneArena(NUMA_PLACEMENT == 1 ? cloneNode[i] : -1, arenaBytes);
+#endif
+			cAll[g] = new SocialForceClone(i, cloneParams, cloneArena[g]);
+			cAll[g]->replica = g / totalClone;
 		}
+		residentCount = numCloneAll;
 
-		SocialForceAgent *agents = cAll[rootCloneId]->ap->agentArray;
-		SocialForceAgent **context = cAll[rootCloneId]->context;
+		// the replicas have the walls of replica 0
+		wallGrid.build(cAll, totalClone);
+		for (int g = 0; g < numCloneAll; g++)
+			cAll[g]->wallGrid = &wallGrid;
 
-		for (int i = 0; i < NUM_CAP; i++) {
-			agents[i].myClone = cAll[rootCloneId];
-			agents[i].contextId = i;
-			agents[i].color = cAll[rootCloneId]->color;
-			agents[i].init(cAll[rootCloneId], i);
-			context[i] = &agents[i];
+		for (int r = 0; r < NUM_REPLICA; r++) {
+			SocialForceClone *root = cAll[replicaRoot(r)];
+			SocialForceAgent *agents = root->ap->agentArray;
+			SocialForceAgent **context = root->context;
+
+			randGen.seed(replicaSeed(r));
+			for (int i = 0; i < NUM_CAP; i++) {
+				agents[i].myClone = root;
+				agents[i].contextId = i;
+				agents[i].color = root->color;
+				agents[i].init(root, i);
+				context[i] = &agents[i];
+			}
+
+			root->numElem = NUM_CAP;
+			for (int j = 0; j < NUM_CAP; j++)
+				root->cloneFlag[j] = true;
 		}
 
-		cAll[rootCloneId]->numElem = NUM_CAP;
-		for (int j = 0; j < NUM_CAP; j++)
-			cAll[rootCloneId]->cloneFlag[j] = true;
+		if (recover && !readCheckpoint())
+			OutputDebugString(L"no checkpoint to recover from, starting at step 0\n");
 
+#if RESIDENT_CLONES > 0
+		while (residentCount > RESIDENT_CLONES && evictOne());
+#endif
 		return EXIT_SUCCESS;
 	}
+	/* splits the subtrees under the root into numBin bins, largest subtree first into the bin
+	with the fewest clones. The root goes to bin 0, every other clone to the bin of its subtree */
+	void assignSubtrees(int numBin, int *binOf) {
+		vector<int> top(totalClone, rootCloneId), subtreeSize(totalClone, 0);
+		for (int i = 0; i < totalClone; i++) {
+			if (i == rootCloneId)
+				continue;
+			int c = i;
+			while (globalParents[c] != rootCloneId)
+				c = globalParents[c];
+			top[i] = c;
+			subtreeSize[c]++;
+		}
+		vector<int> tops;
+		for (int i = 0; i < totalClone; i++)
+			if (subtreeSize[i] > 0)
+				tops.push_back(i);
+		stable_sort(tops.begin(), tops.end(), [&](int a, int b) {
+			return subtreeSize[a] > subtreeSize[b];
+		});
+
+		vector<int> binLoad(numBin, 0);
+		binLoad[0] = 1;
+		binOf[rootCloneId] = 0;
+		for (int k = 0; k < tops.size(); k++) {
+			int bin = min_element(binLoad.begin(), binLoad.end()) - binLoad.begin();
+			binOf[tops[k]] = bin;
+			binLoad[bin] += subtreeSize[tops[k]];
+		}
+		for (int i = 0; i < totalClone; i++)
+			if (i != rootCloneId)
+				binOf[i] = binOf[top[i]];
+	}
+	// reads the worker setup from the environment, returns whether to recover from a checkpoint
+	bool initWorkers() {
+		char value[16];
+		if (GetEnvironmentVariableA("GSIM_WORKERS", value, 16) > 0)
+			numWorkers = max(atoi(value), 1);
+		if (GetEnvironmentVariableA("GSIM_RANK", value, 16) > 0)
+			workerRank = atoi(value);
+		bool recover = GetEnvironmentVariableA("GSIM_RECOVER", value, 16) > 0 && atoi(value) == 1;
+		if (numWorkers > MAX_WORKERS || workerRank < 0 || workerRank >= numWorkers) {
+			wchar_t message[128];
+			swprintf_s(message, 128, L"GSIM_RANK %d of GSIM_WORKERS %d, need 0 <= rank < workers <= %d\n", workerRank, numWorkers, MAX_WORKERS);
+			OutputDebugString(message);
+			exit(EXIT_FAILURE);
+		}
+
+		cloneRank = new int[totalClone];
+		assignSubtrees(numWorkers, cloneRank);
+		if (numWorkers > 1) {
+			rootSnapshot = new AgentState[NUM_CAP * NUM_REPLICA];
+			SharedMemoryTransport *shm = new SharedMemoryTransport("Local\\GSimCloneRing", sizeof(AgentState) * NUM_CAP * NUM_REPLICA, numWorkers);
+			if (shm->good())
+				transport = shm;
+			else
+				OutputDebugString(L"shared memory transport failed, every worker steps the root itself\n");
+		}
+		if (transport != NULL)
+			joinWorkers();
+		return recover;
+	}
+	/* a worker registers with an ack of step 0. Until its first ack publish would take it for
+	lost and overwrite the steps it still needs, so rank 0 waits for every worker before step 1 */
+	void joinWorkers() {
+		if (workerRank > 0) {
+			transport->ack(workerRank, 0);
+			return;
+		}
+		ULONGLONG start = GetTickCount64();
+		bool reported = false;
+		for (int r = 1; r < numWorkers; r++)
+			while (!transport->joined(r)) {
+				if (!reported && GetTickCount64() - start > WORKER_TIMEOUT_MS) {
+					wchar_t message[64];
+					swprintf_s(message, 64, L"waiting for worker %d to start\n", r);
+					OutputDebugString(message);
+					reported = true;
+				}
+				Sleep(1);
+			}
+	}
+	bool isLocal(int cloneId) {
+		return cloneRank[treePos(cloneId)] == workerRank;
+	}
+	void stepRoots() {
+		for (int r = 0; r < NUM_REPLICA; r++)
+			cAll[replicaRoot(r)]->step(stepCount);
+	}
+	// a root owns every context slot, so the snapshot is indexed by replica and contextId
+	void publishRoot() {
+		for (int r = 0; r < NUM_REPLICA; r++) {
+			SocialForceClone *root = cAll[replicaRoot(r)];
+			for (int i = 0; i < NUM_CAP; i++)
+				root->context[i]->saveState(rootSnapshot[r * NUM_CAP + i]);
+		}
+		transport->publish(stepCount, rootSnapshot, sizeof(AgentState) * NUM_CAP * NUM_REPLICA);
+	}
+	/* mirrors the root of this step. The simulation is deterministic, so a worker that finds
+	the step already gone from the ring (it was lost or fell behind) steps the root itself. It
+	acks that step as well, so rank 0 keeps the next steps in the ring for it */
+	void fetchRoot() {
+		int status = 0;
+		if (transport != NULL)
+			while ((status = transport->fetch(stepCount, rootSnapshot, sizeof(AgentState) * NUM_CAP * NUM_REPLICA)) == 0)
+				Sleep(0);
+		if (status == 1) {
+			for (int r = 0; r < NUM_REPLICA; r++) {
+				SocialForceClone *root = cAll[replicaRoot(r)];
+				for (int i = 0; i < NUM_CAP; i++)
+					root->context[i]->loadState(rootSnapshot[r * NUM_CAP + i], root);
+			}
+		}
+		else
+			stepRoots();
+		if (transport != NULL)
+			transport->ack(workerRank, stepCount);
+	}
+	/* a checkpoint holds a header of NUM_CAP, NUM_REPLICA, numCloneAll and the step, then the
+	roots and the local clones: the pool order, cloneFlag and the state of every own agent. It
+	is written to a temporary file first and then renamed */
+	void writeCheckpoint() {
+		char name[32], tmp[32];
+		sprintf_s(name, 32, "checkpoint_%d.bin", workerRank);
+		sprintf_s(tmp, 32, "checkpoint_%d.tmp", workerRank);
+		ofstream out(tmp, ios::out | ios::binary);
+		int header[4] = { NUM_CAP, NUM_REPLICA, numCloneAll, stepCount };
+		out.write((char*)header, sizeof(header));
+		for (int c = 0; c < numCloneAll; c++) {
+			if (!isRoot(c) && !isLocal(c))
+				continue;
+			ensureResident(c);
+			SocialForceClone *clone = cAll[c];
+			out.write((char*)&clone->numElem, sizeof(int));
+			out.write((char*)clone->cloneFlag, sizeof(bool) * NUM_CAP);
+			for (int i = 0; i < clone->numElem; i++) {
+				AgentState state;
+				clone->ap->agentPtrArray[i]->saveState(state);
+				out.write((char*)&state, sizeof(AgentState));
+			}
+		}
+		out.close();
+		MoveFileExA(tmp, name, MOVEFILE_REPLACE_EXISTING);
+	}
+	/* the whole checkpoint is read and checked before any clone is touched, one written with
+	another configuration or cut short leaves the clones as initSimClone set them up */
+	bool readCheckpoint() {
+		char name[32];
+		sprintf_s(name, 32, "checkpoint_%d.bin", workerRank);
+		ifstream in(name, ios::in | ios::binary);
+		if (!in.is_open())
+			return false;
+		int header[4];
+		in.read((char*)header, sizeof(header));
+		if (!in.good() || header[0] != NUM_CAP || header[1] != NUM_REPLICA || header[2] != numCloneAll) {
+			OutputDebugString(L"checkpoint is from another configuration\n");
+			return false;
+		}
+		vector<int> numElem(numCloneAll, 0);
+		vector<char> flags((size_t)numCloneAll * NUM_CAP);
+		vector<AgentState> states;
+		for (int c = 0; c < numCloneAll; c++) {
+			if (!isRoot(c) && !isLocal(c))
+				continue;
+			in.read((char*)&numElem[c], sizeof(int));
+			if (!in.good() || numElem[c] < 0 || numElem[c] > NUM_CAP) {
+				OutputDebugString(L"checkpoint is damaged\n");
+				return false;
+			}
+			in.read(&flags[(size_t)c * NUM_CAP], sizeof(bool) * NUM_CAP);
+			size_t first = states.size();
+			states.resize(first + numElem[c]);
+			if (numElem[c] > 0)
+				in.read((char*)&states[first], sizeof(AgentState) * numElem[c]);
+		}
+		if (!in.good()) {
+			OutputDebugString(L"checkpoint is damaged\n");
+			return false;
+		}
+
+		stepCount = header[3];
+		size_t next = 0;
+		for (int c = 0; c < numCloneAll; c++) {
+			if (!isRoot(c) && !isLocal(c))
+				continue;
+			SocialForceClone *clone = cAll[c];
+			clone->numElem = numElem[c];
+			memcpy(clone->cloneFlag, &flags[(size_t)c * NUM_CAP], sizeof(bool) * NUM_CAP);
+			for (int i = 0; i < NUM_CAP; i++) {
+				clone->ap->takenFlags[i] = i < clone->numElem;
+				clone->verletStale[i] = true;
+			}
+			for (int i = 0; i < clone->numElem; i++)
+				clone->ap->agentPtrArray[i]->loadState(states[next++], clone);
+		}
+		return true;
+	}
+	// assigns the subtrees under the root to NUMA nodes, see assignSubtrees
+	void placeSubtrees() {
+		for (int i = 0; i < totalClone; i++)
+			cloneNode[i] = 0;
+#if NUMA_PLACEMENT == 1
+		ULONG highestNode = 0;
+		GetNumaHighestNodeNumber(&highestNode);
+		numNode = highestNode + 1;
+		assignSubtrees(numNode, cloneNode);
+		pinWorker();
+#endif
+	}
+	/* thread t of the OpenMP team works for node t % numNode. The team threads are kept from one
+	parallel region to the next, so a thread is pinned the first time it runs here. The master
+	thread stays on node 0, which holds the root */
+	int pinWorker() {
+		static __declspec(thread) int pinnedNode = -1;
+		int node = omp_get_thread_num() % numNode;
+		if (pinnedNode != node) {
+			pinToNumaNode(node);
+			pinnedNode = node;
+		}
+		return node;
+	}
+	/* steps the clones of a level with the team split by node: every node has a queue of its
+	clones in the heaviest first order, a thread takes from the queue of its own node and helps
+	the other nodes only once that is empty */
+	void procByNode(const vector<int> &order) {
+		vector<vector<int> > queue(numNode);
+		for (int j = 0; j < order.size(); j++)
+			queue[cloneNode[treePos(order[j])]].push_back(order[j]);
+		vector<LONG> next(numNode, 0);
+#pragma omp parallel
+		{
+			int node = pinWorker();
+			for (int k = 0; k < numNode; k++) {
+				int n = (node + k) % numNode;
+				for (LONG j; (j = InterlockedIncrement(&next[n]) - 1) < (LONG)queue[n].size();) {
+					int childCloneId = queue[n][j];
+					proc(parentOf(childCloneId), childCloneId, 0, "g1");
+				}
+			}
+		}
+	}
+	void initResidency() {
+		cloneArena = new CloneArena*[numCloneAll];
+		cloneLevel = new int[totalClone];
+		subtreeLastLevel = new int[totalClone];
+		lastUse = new int[numCloneAll];
+		processedStep = new int[numCloneAll];
+		swappedStep = new int[numCloneAll];
+		pinned = new bool[numCloneAll];
+		for (int i = 0; i < totalClone; i++)
+			cloneLevel[i] = 0;
+		for (int i = 0; i < numCloneAll; i++) {
+			lastUse[i] = 0;
+			processedStep[i] = 0;
+			swappedStep[i] = 0;
+			pinned[i] = false;
+		}
+		for (int l = 0; l < cloningTree.size(); l++)
+			for (int j = 0; j < cloningTree[l].size(); j++)
+				cloneLevel[cloningTree[l][j]] = l;
+		for (int i = 0; i < totalClone; i++)
+			subtreeLastLevel[i] = cloneLevel[i];
+		for (int l = cloningTree.size() - 1; l > 0; l--)
+			for (int j = 0; j < cloningTree[l].size(); j++) {
+				int c = cloningTree[l][j];
+				int p = globalParents[c];
+				subtreeLastLevel[p] = max(subtreeLastLevel[p], subtreeLastLevel[c]);
+			}
+	}
+	bool isResident(int c) {
+		return cloneArena[c] == NULL || cloneArena[c]->resident;
+	}
+	// levels until the clone is used again, counted from the running level
+	int nextUse(int g) {
+		int c = treePos(g);
+		if (c != rootCloneId && !isLocal(c))
+			return INT_MAX;
+		if (cloneLevel[c] > currentLevel)
+			return cloneLevel[c] - currentLevel;
+		if (subtreeLastLevel[c] > currentLevel)
+			return 1;
+		return (int)cloningTree.size() - currentLevel + cloneLevel[c];
+	}
+	bool evictOne() {
+		int victim = -1;
+		for (int c = 0; c < numCloneAll; c++) {
+			if (isRoot(c) || pinned[c] || !isResident(c))
+				continue;
+			if (victim == -1 || nextUse(c) > nextUse(victim)
+				|| (nextUse(c) == nextUse(victim) && lastUse[c] < lastUse[victim]))
+				victim = c;
+		}
+		if (victim == -1)
+			return false;
+		char path[32];
+		sprintf_s(path, 32, "spill_%d_%d.bin", workerRank, victim);
+		if (!cloneArena[victim]->spill(path))
+			return false;
+		residentCount--;
+		return true;
+	}
+	void ensureResident(int c) {
+		lastUse[c] = ++useClock;
+		if (isResident(c))
+			return;
+		while (residentCount >= RESIDENT_CLONES && evictOne());
+		if (!cloneArena[c]->pageIn()) {
+			OutputDebugString(L"paging in a spilled clone failed\n");
+			exit(EXIT_FAILURE);
+		}
+		residentCount++;
+		if (processedStep[c] > swappedStep[c]) {
+			cAll[c]->swap();
+			swappedStep[c] = processedStep[c];
+		}
+	}
+	// pins the given clones, their ancestors and the clone of the dialog
+	void pinChains(const vector<int> &clones) {
+		memset(pinned, 0, sizeof(bool) * numCloneAll);
+		for (int j = 0; j <= clones.size(); j++) {
+			int c = j < clones.size() ? clones[j] : heldId;
+			for (; c >= 0 && !pinned[c]; c = parentOf(c)) {
+				pinned[c] = true;
+				if (isRoot(c))
+					break;
+			}
+		}
+	}
+	// pages in the clones of a level and every ancestor their contexts point into
+	void residentLevel(const vector<int> &order) {
+		pinChains(order);
+		for (int j = 0; j < order.size(); j++)
+			for (int c = order[j]; ; c = parentOf(c)) {
+				ensureResident(c);
+				if (isRoot(c))
+					break;
+			}
+	}
+	/* runs beside a level: pages in the clones of the next level, heaviest first as they will be
+	dispatched, as long as the budget has room. It never evicts, so it cannot touch a clone of
+	the running level */
+	void prefetchLevel(vector<int> next) {
+		stable_sort(next.begin(), next.end(), [&](int a, int b) {
+			return predictCost(cAll[a]) > predictCost(cAll[b]);
+		});
+		for (int j = 0; j < next.size() && residentCount < RESIDENT_CLONES; j++) {
+			int c = next[j];
+			if (!isResident(c) && cloneArena[c]->pageIn()) {
+				residentCount++;
+				if (processedStep[c] > swappedStep[c]) {
+					cAll[c]->swap();
+					swappedStep[c] = processedStep[c];
+				}
+			}
+		}
+	}
+	// keeps the clone shown by the dialog and its ancestors in memory
+	void holdResident(int cloneId) {
+#if RESIDENT_CLONES > 0
+		heldId = cloneId;
+		pinChains(vector<int>());
+		for (int c = cloneId; ; c = parentOf(c)) {
+			ensureResident(c);
+			if (isRoot(c))
+				break;
+		}
+#endif
+	}
 	bool cloningCondition(SocialForceAgent *agent, bool *childTakenMap,
 		SocialForceClone *parentClone, SocialForceClone *childClone) {
 
@@ -773,8 +1923,8 @@ public:
 		if (childClone->cloneFlag[agent->contextId] == true)
 			return false;
 
-		// active cloning condition
-		double2 &loc = agent->data.loc;
+		// active cloning condition: a changed gate within reach of the wall force
+		real2_store &loc = agent->data.loc;
 		for (int i = 0; i < NUM_PARAM; i++) {
 			if (parentClone->cloneParams[i] == childClone->cloneParams[i])
 				continue;
@@ -783,19 +1933,19 @@ public:
 			obstacleLine g0 = obstacleLine(0, 0, 0, 0);
 			if (g1 != g2) {
 				obstacleLine gate = (g1 != g0) ? g1 : g2;
-				if (gate.pointToLineDist(loc) < 6)
+				if (gate.pointToLineDist(cast2<double2>(loc)) < g_wallCutoff)
 					return true;
 			}
 		}
 
 		// passive cloning condition
-		int minx = max((loc.x - RADIUS_I) / CELL_DIM, 0);
-		int miny = max((loc.y - RADIUS_I) / CELL_DIM, 0);
-		int maxx = min((loc.x + RADIUS_I) / CELL_DIM, NUM_CELL - 1);
-		int maxy = min((loc.y + RADIUS_I) / CELL_DIM, NUM_CELL - 1);
+		int minx = max((loc.x - g_cutoff) / g_takenCellDim, 0);
+		int miny = max((loc.y - g_cutoff) / g_takenCellDim, 0);
+		int maxx = min((loc.x + g_cutoff) / g_takenCellDim, g_takenCellNum - 1);
+		int maxy = min((loc.y + g_cutoff) / g_takenCellDim, g_takenCellNum - 1);
 		for (int i = minx; i <= maxx; i++)
 			for (int j = miny; j <= maxy; j++)
-				if (childTakenMap[i * NUM_CELL + j])
+				if (childTakenMap[i * g_takenCellNum + j])
 					return true;
 
 		// pass all the check, don't need to be cloned
@@ -807,37 +1957,29 @@ public:
 		// 1. copy the context of parent clone
 		memcpy(childClone->context, parentClone->context, NUM_CAP * sizeof(void*));
 
-		// 2. update the context with agents of its own
+		// 2. update the context with agents of its own, their origin is what the parent holds now
 		for (int i = 0; i < childClone->numElem; i++) {
 			SocialForceAgent *agent = childClone->ap->agentPtrArray[i];
+			agent->myOrigin = parentClone->context[agent->contextId];
 			childClone->context[agent->contextId] = agent;
 		}
 
 		// 3. construct passive cloning map
 		double2 dim = make_double2(ENV_DIM, ENV_DIM);
-		memset(childClone->takenMap, 0, sizeof(bool) * NUM_CELL * NUM_CELL);
+		memset(childClone->takenMap, 0, sizeof(bool) * g_takenCellNum * g_takenCellNum);
 		for (int i = 0; i < childClone->numElem; i++) {
 			const SocialForceAgent &agent = *childClone->ap->agentPtrArray[i];
-			int takenId = agent.data.loc.x / CELL_DIM;
-			takenId = takenId * NUM_CELL + agent.data.loc.y / CELL_DIM;
+			int takenId = agent.data.loc.x / g_takenCellDim;
+			takenId = takenId * g_takenCellNum + agent.data.loc.y / g_takenCellDim;
 			childClone->takenMap[takenId] = true;
 		}
 
 		// 4. perform active and passive cloning (in cloningCondition checking)
-		for (int i = 0; i < parentClone->numElem; i++) {
-			SocialForceAgent *agent = parentClone->ap->agentPtrArray[i];
-		
 		//for (int i = 0; i < NUM_CAP; i++) {
 		//	SocialForceAgent *agent = parentClone->context[i];
-			if (cloningCondition(agent, childClone->takenMap, parentClone, childClone)) {
-				SocialForceAgent &childAgent = *childClone->ap->agentPtrArray[childClone->numElem];
-				childClone->ap->takenFlags[childClone->numElem] = true;
-				childAgent.initNewClone(agent, childClone);
-				childClone->context[childAgent.contextId] = &childAgent;
-				childClone->cloneFlag[childAgent.contextId] = true;
-				childClone->numElem++;
-			}
-		}
+		childClone->appendClones(parentClone->ap->agentPtrArray, parentClone->numElem, [&](SocialForceAgent *agent) {
+			return cloningCondition(agent, childClone->takenMap, parentClone, childClone);
+		});
 	}
 	void compareAndEliminate(SocialForceClone *parentClone, SocialForceClone *childClone) {
 		wchar_t message[20];
@@ -845,9 +1987,13 @@ public:
 			SocialForceAgent &childAgent = *childClone->ap->agentPtrArray[i];
 			SocialForceAgent &parentAgent = *childAgent.myOrigin;
 
+#if FIXED_POINT_STATE == 1
+			if (fixedEqual(childAgent.fixedCopy, parentAgent.fixedCopy)) {
+#else
 			double velDiff = length(childAgent.dataCopy.velocity - parentAgent.dataCopy.velocity);
 			double locDiff = length(childAgent.dataCopy.loc - parentAgent.dataCopy.loc);
 			if (locDiff == 0 && velDiff == 0) {
+#endif
 				childClone->ap->takenFlags[i] = false;
 				childClone->cloneFlag[childAgent.contextId] = false;
 			}
@@ -864,8 +2010,9 @@ public:
 	void proc(int p, int c, bool o, char *s) {
 		double start = GetCounter();
 		performClone(cAll[p], cAll[c]);
-		fout1 << GetCounter() - start << " ";
+		cAll[c]->cloneTime = GetCounter() - start;
 		cAll[c]->step(stepCount);
+		cAll[c]->updateWork();
 		if (o) {
 			if (stepCount < 1000)
 				cAll[c]->output(stepCount, s);
@@ -874,6 +2021,27 @@ public:
 		//cAll[c]->output2(stepCount, s);
 		
 		compareAndEliminate(cAll[p], cAll[c]);
+		processedStep[c] = stepCount;
+		double cost = GetCounter() - start;
+		cAll[c]->costLast = cost;
+		cAll[c]->costEma = cAll[c]->costEma == 0 ? cost : COST_EMA * cost + (1 - COST_EMA) * cAll[c]->costEma;
+	}
+
+	/* predicted proc time of a clone: the work of its last step at the cost per work unit
+	seen over all clones, blended with its own measured history */
+	double predictCost(SocialForceClone *c) {
+		double model = costPerWork * c->work;
+		if (c->costEma == 0)
+			return model;
+		return COST_EMA * c->costEma + (1 - COST_EMA) * model;
+	}
+	void updateCostModel(SocialForceClone *c) {
+		if (c->work > 0) {
+			double perWork = c->costLast / c->work;
+			costPerWork = costPerWork == 0 ? perWork : COST_EMA * perWork + (1 - COST_EMA) * costPerWork;
+		}
+		// step, clone, predicted and measured time, work
+		foutCost << stepCount << " " << c->cloneid << " " << c->costPred << " " << c->costLast << " " << c->work << '\n';
 	}
 
 	double PCFreq = 0.0;
@@ -906,19 +2074,76 @@ public:
 		// exp3CloneTree6: RAND3
 		stepCount++;
 
-		cAll[rootCloneId]->step(stepCount);
+		if (isLocal(rootCloneId)) {
+			stepRoots();
+			if (transport != NULL)
+				publishRoot();
+		}
+		else
+			fetchRoot();
 		for (int i = 1; i < cloningTree.size(); i++) {
-			for (int j = 0; j < cloningTree[i].size(); j++) {
-				int childCloneId = cloningTree[i][j];
-				int parentCloneId = globalParents[childCloneId];
+			// parents live on earlier levels, so the clones of a level are independent, they
+			// are dispatched heaviest first so the long ones do not start last
+			vector<int> level;
+			for (int r = 0; r < NUM_REPLICA; r++)
+				for (int j = 0; j < cloningTree[i].size(); j++)
+					if (isLocal(cloningTree[i][j]))
+						level.push_back(r * totalClone + cloningTree[i][j]);
+			vector<int> order(level);
+			for (int j = 0; j < level.size(); j++)
+				cAll[level[j]]->costPred = predictCost(cAll[level[j]]);
+			stable_sort(order.begin(), order.end(), [&](int a, int b) {
+				return cAll[a]->costPred > cAll[b]->costPred;
+			});
+			currentLevel = i;
+			thread prefetcher;
+#if RESIDENT_CLONES > 0
+			residentLevel(order);
+			if (i + 1 < cloningTree.size()) {
+				vector<int> next;
+				for (int r = 0; r < NUM_REPLICA; r++)
+					for (int j = 0; j < cloningTree[i + 1].size(); j++)
+						if (isLocal(cloningTree[i + 1][j]))
+							next.push_back(r * totalClone + cloningTree[i + 1][j]);
+				prefetcher = thread(&SocialForceSimApp::prefetchLevel, this, next);
+			}
+#endif
+#if NUMA_PLACEMENT == 1
+			procByNode(order);
+#else
+#pragma omp parallel for schedule(dynamic, 1)
+			for (int j = 0; j < (int)order.size(); j++) {
+				int childCloneId = order[j];
+				int parentCloneId = parentOf(childCloneId);
 				proc(parentCloneId, childCloneId, 0, "g1");
 			}
+#endif
+			if (prefetcher.joinable())
+				prefetcher.join();
+			for (int j = 0; j < level.size(); j++) {
+				fout1 << cAll[level[j]]->cloneTime << " ";
+				updateCostModel(cAll[level[j]]);
+			}
 		}
 
 		fout1 << endl;
 
-		for (int i = 0; i < totalClone; i++)
-			cAll[i]->swap();
+#if CUTOFF_VALIDATION == 1
+		wchar_t message[128];
+		swprintf_s(message, 128, L"step %d: max force error from cutoff %e\n", stepCount, g_cutoffMaxErr);
+		OutputDebugString(message);
+		g_cutoffMaxErr = 0;
+#endif
+
+		// a spilled clone swaps when it is paged in again
+		for (int i = 0; i < numCloneAll; i++)
+			if (isResident(i)) {
+				cAll[i]->swap();
+				swappedStep[i] = stepCount;
+			}
+
+		if (numWorkers > 1 && stepCount % CHECKPOINT_INTERVAL == 0)
+			writeCheckpoint();
 	}
 	void stepApp0(){
 		// exp3. tree structure, MST.
@@ -1047,6 +2272,7 @@ public:
 class SocialForceSimApp1 {
 public:
 	SocialForceClone **cAll;
+	WallGrid wallGrid;
 	int paintId = 0;
 	int totalClone = 1;
 	int &stepCount = g_stepCount;
@@ -1060,7 +2286,8 @@ public:
 		freopen_s(&pCout, "conout$", "w", stdout);
 		freopen_s(&pCout, "conout$", "w", stderr);
 
-		srand(0);
+		g_config.load(SIM_CONFIG_FILE);
+		setInteractionCutoff(AGENT_MASS);
 
 		cAll = new SocialForceClone*[totalClone];
 		cloneTree = new int*[2];
@@ -1074,6 +2301,10 @@ public:
 			cAll[i] = new SocialForceClone(i, cloneParams);
 		}
 
+		wallGrid.build(cAll, totalClone);
+		for (int i = 0; i < totalClone; i++)
+			cAll[i]->wallGrid = &wallGrid;
+
 		SocialForceAgent *agents = cAll[rootCloneId]->ap->agentArray;
 		SocialForceAgent **context = cAll[rootCloneId]->context;
 
@@ -1100,8 +2331,8 @@ public:
 		if (childClone->cloneFlag[agent->contextId] == true)
 			return false;
 
-		// active cloning condition
-		double2 &loc = agent->data.loc;
+		// active cloning condition: a changed gate within reach of the wall force
+		real2_store &loc = agent->data.loc;
 		for (int i = 0; i < NUM_PARAM; i++) {
 			if (parentClone->cloneParams[i] == childClone->cloneParams[i])
 				continue;
@@ -1110,19 +2341,19 @@ public:
 			obstacleLine g0 = obstacleLine(0, 0, 0, 0);
 			if (g1 != g2) {
 				obstacleLine gate = (g1 != g0) ? g1 : g2;
-				if (gate.pointToLineDist(loc) < 6)
+				if (gate.pointToLineDist(cast2<double2>(loc)) < g_wallCutoff)
 					return true;
 			}
 		}
 
 		// passive cloning condition
-		int minx = max((loc.x - RADIUS_I) / CELL_DIM, 0);
-		int miny = max((loc.y - RADIUS_I) / CELL_DIM, 0);
-		int maxx = min((loc.x + RADIUS_I) / CELL_DIM, NUM_CELL - 1);
-		int maxy = min((loc.y + RADIUS_I) / CELL_DIM, NUM_CELL - 1);
+		int minx = max((loc.x - g_cutoff) / g_takenCellDim, 0);
+		int miny = max((loc.y - g_cutoff) / g_takenCellDim, 0);
+		int maxx = min((loc.x + g_cutoff) / g_takenCellDim, g_takenCellNum - 1);
+		int maxy = min((loc.y + g_cutoff) / g_takenCellDim, g_takenCellNum - 1);
 		for (int i = minx; i <= maxx; i++)
 			for (int j = miny; j <= maxy; j++)
-				if (childTakenMap[i * NUM_CELL + j])
+				if (childTakenMap[i * g_takenCellNum + j])
 					return true;
 
 		// pass all the check, don't need to be cloned
@@ -1142,26 +2373,18 @@ public:
 
 		// 3. construct passive cloning map
 		double2 dim = make_double2(ENV_DIM, ENV_DIM);
-		memset(childClone->takenMap, 0, sizeof(bool) * NUM_CELL * NUM_CELL);
+		memset(childClone->takenMap, 0, sizeof(bool) * g_takenCellNum * g_takenCellNum);
 		for (int i = 0; i < childClone->numElem; i++) {
 			const SocialForceAgent &agent = *childClone->ap->agentPtrArray[i];
-			int takenId = agent.data.loc.x / CELL_DIM;
-			takenId = takenId * NUM_CELL + agent.data.loc.y / CELL_DIM;
+			int takenId = agent.data.loc.x / g_takenCellDim;
+			takenId = takenId * g_takenCellNum + agent.data.loc.y / g_takenCellDim;
 			childClone->takenMap[takenId] = true;
 		}
 
 		// 4. perform active and passive cloning (in cloningCondition checking)
-		for (int i = 0; i < NUM_CAP; i++) {
-			SocialForceAgent *agent = parentClone->context[i];
-			if (cloningCondition(agent, childClone->takenMap, parentClone, childClone)) {
-				SocialForceAgent &childAgent = *childClone->ap->agentPtrArray[childClone->numElem];
-				childClone->ap->takenFlags[childClone->numElem] = true;
-				childAgent.initNewClone(agent, childClone);
-				childClone->context[childAgent.contextId] = &childAgent;
-				childClone->cloneFlag[childAgent.contextId] = true;
-				childClone->numElem++;
-			}
-		}
+		childClone->appendClones(parentClone->context, NUM_CAP, [&](SocialForceAgent *agent) {
+			return cloningCondition(agent, childClone->takenMap, parentClone, childClone);
+		});
 	}
 	void compareAndEliminate(SocialForceClone *parentClone, SocialForceClone *childClone) {
 		wchar_t message[20];
@@ -1169,9 +2392,13 @@ public:
 			SocialForceAgent &childAgent = *childClone->ap->agentPtrArray[i];
 			SocialForceAgent &parentAgent = *childAgent.myOrigin;
 
+#if FIXED_POINT_STATE == 1
+			if (fixedEqual(childAgent.fixedCopy, parentAgent.fixedCopy)) {
+#else
 			double velDiff = length(childAgent.dataCopy.velocity - parentAgent.dataCopy.velocity);
 			double locDiff = length(childAgent.dataCopy.loc - parentAgent.dataCopy.loc);
 			if (locDiff == 0 && velDiff == 0) {
+#endif
 				childClone->ap->takenFlags[i] = false;
 				childClone->cloneFlag[childAgent.contextId] = false;
 			}
@@ -1207,7 +2434,7 @@ public:
 	void quickSort(int **cloneTree, int l, int r) {
 		if (l == r)
 			return;
-		int pi = l + rand() % (r - l);
+		int pi = l + util::randomBits(0, l, 0, r).x % (r - l);
 		swap(cloneTree, l, pi);
 		int pivot = cloneTree[0][l];
 
@@ -1297,6 +2524,7 @@ public:
 class SocialForceSimApp2 {
 public:
 	SocialForceClone **cAll;
+	WallGrid wallGrid;
 	int paintId = 1;
 	int totalClone = 27;
 	int &stepCount = g_stepCount;
@@ -1304,7 +2532,8 @@ public:
 	int **cloneTree;
 
 	int initSimClone() {
-		srand(0);
+		g_config.load(SIM_CONFIG_FILE);
+		setInteractionCutoff(AGENT_MASS);
 
 		cAll = new SocialForceClone*[totalClone];
 		cloneTree = new int*[2];
@@ -1318,6 +2547,10 @@ public:
 			cAll[i] = new SocialForceClone(i, cloneParams);
 		}
 
+		wallGrid.build(cAll, totalClone);
+		for (int i = 0; i < totalClone; i++)
+			cAll[i]->wallGrid = &wallGrid;
+
 		for (int cloneid = 0; cloneid < totalClone; cloneid++) {
 			SocialForceAgent *agents = cAll[cloneid]->ap->agentArray;
 			SocialForceAgent **context = cAll[cloneid]->context;
@@ -1346,8 +2579,8 @@ public:
 		if (childClone->cloneFlag[agent->contextId] == true)
 			return false;
 
-		// active cloning condition
-		double2 &loc = agent->data.loc;
+		// active cloning condition: a changed gate within reach of the wall force
+		real2_store &loc = agent->data.loc;
 		for (int i = 0; i < NUM_PARAM; i++) {
 			if (parentClone->cloneParams[i] == childClone->cloneParams[i])
 				continue;
@@ -1356,19 +2589,19 @@ public:
 			obstacleLine g0 = obstacleLine(0, 0, 0, 0);
 			if (g1 != g2) {
 				obstacleLine gate = (g1 != g0) ? g1 : g2;
-				if (gate.pointToLineDist(loc) < 6)
+				if (gate.pointToLineDist(cast2<double2>(loc)) < g_wallCutoff)
 					return true;
 			}
 		}
 
 		// passive cloning condition
-		int minx = max((loc.x - RADIUS_I) / CELL_DIM, 0);
-		int miny = max((loc.y - RADIUS_I) / CELL_DIM, 0);
-		int maxx = min((loc.x + RADIUS_I) / CELL_DIM, NUM_CELL - 1);
-		int maxy = min((loc.y + RADIUS_I) / CELL_DIM, NUM_CELL - 1);
+		int minx = max((loc.x - g_cutoff) / g_takenCellDim, 0);
+		int miny = max((loc.y - g_cutoff) / g_takenCellDim, 0);
+		int maxx = min((loc.x + g_cutoff) / g_takenCellDim, g_takenCellNum - 1);
+		int maxy = min((loc.y + g_cutoff) / g_takenCellDim, g_takenCellNum - 1);
 		for (int i = minx; i <= maxx; i++)
 			for (int j = miny; j <= maxy; j++)
-				if (childTakenMap[i * NUM_CELL + j])
+				if (childTakenMap[i * g_takenCellNum + j])
 					return true;
 
 		// pass all the check, don't need to be cloned
@@ -1388,26 +2621,18 @@ public:
 
 		// 3. construct passive cloning map
 		double2 dim = make_double2(ENV_DIM, ENV_DIM);
-		memset(childClone->takenMap, 0, sizeof(bool) * NUM_CELL * NUM_CELL);
+		memset(childClone->takenMap, 0, sizeof(bool) * g_takenCellNum * g_takenCellNum);
 		for (int i = 0; i < childClone->numElem; i++) {
 			const SocialForceAgent &agent = *childClone->ap->agentPtrArray[i];
-			int takenId = agent.data.loc.x / CELL_DIM;
-			takenId = takenId * NUM_CELL + agent.data.loc.y / CELL_DIM;
+			int takenId = agent.data.loc.x / g_takenCellDim;
+			takenId = takenId * g_takenCellNum + agent.data.loc.y / g_takenCellDim;
 			childClone->takenMap[takenId] = true;
 		}
 
 		// 4. perform active and passive cloning (in cloningCondition checking)
-		for (int i = 0; i < NUM_CAP; i++) {
-			SocialForceAgent *agent = parentClone->context[i];
-			if (cloningCondition(agent, childClone->takenMap, parentClone, childClone)) {
-				SocialForceAgent &childAgent = *childClone->ap->agentPtrArray[childClone->numElem];
-				childClone->ap->takenFlags[childClone->numElem] = true;
-				childAgent.initNewClone(agent, childClone);
-				childClone->context[childAgent.contextId] = &childAgent;
-				childClone->cloneFlag[childAgent.contextId] = true;
-				childClone->numElem++;
-			}
-		}
+		childClone->appendClones(parentClone->context, NUM_CAP, [&](SocialForceAgent *agent) {
+			return cloningCondition(agent, childClone->takenMap, parentClone, childClone);
+		});
 	}
 	void compareAndEliminate(SocialForceClone *parentClone, SocialForceClone *childClone) {
 		wchar_t message[20];
@@ -1415,9 +2640,13 @@ public:
 			SocialForceAgent &childAgent = *childClone->ap->agentPtrArray[i];
 			SocialForceAgent &parentAgent = *childAgent.myOrigin;
 
+#if FIXED_POINT_STATE == 1
+			if (fixedEqual(childAgent.fixedCopy, parentAgent.fixedCopy)) {
+#else
 			double velDiff = length(childAgent.dataCopy.velocity - parentAgent.dataCopy.velocity);
 			double locDiff = length(childAgent.dataCopy.loc - parentAgent.dataCopy.loc);
 			if (locDiff == 0 && velDiff == 0) {
+#endif
 				childClone->ap->takenFlags[i] = false;
 				childClone->cloneFlag[childAgent.contextId] = false;
 			}
@@ -1453,7 +2682,7 @@ public:
 	void quickSort(int **cloneTree, int l, int r) {
 		if (l == r)
 			return;
-		int pi = l + rand() % (r - l);
+		int pi = l + util::randomBits(0, l, 0, r).x % (r - l);
 		swap(cloneTree, l, pi);
 		int pivot = cloneTree[0][l];
 
@@ -1537,4 +2766,4 @@ public:
 		for (int i = 0; i < totalClone; i++)
 			cAll[i]->swap();
 	}
-};
\ No newline at end of file
+};
\ No newline at end of file
@@ -5,6 +5,7 @@
 #include "stdafx.h"
 #include "TestVisual2.h"
 #include "TestVisual2Dlg.h"
+#include "TrajectoryCompare.h"
 
 #ifdef _DEBUG
 #define new DEBUG_NEW
@@ -51,6 +52,20 @@ BOOL CTestVisual2App::InitInstance()
 
 	CWinApp::InitInstance();
 
+	// TestVisual2 -compare base.txt test.txt report.txt compares two trajectories written by
+	// SocialForceClone::output(), see TrajectoryCompare.h, and exits without the dialog
+	if (__argc == 5 && _tcscmp(__targv[1], _T("-compare")) == 0)
+	{
+		double worst = compareTrajectory(CT2A(__targv[2]), CT2A(__targv[3]), CT2A(__targv[4]));
+		CString msg;
+		if (worst < 0)
+			msg.Format(_T("cannot read %s or %s\n"), __targv[2], __targv[3]);
+		else
+			msg.Format(_T("largest location error %g, per step errors in %s\n"), worst, __targv[4]);
+		OutputDebugString(msg);
+		return FALSE;
+	}
+
 
 	AfxEnableControlContainer();
 
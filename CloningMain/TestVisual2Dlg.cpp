@@ -21,6 +21,10 @@
 //#include "SocialForceGPU2.h"
 //#include "SocialForceGPU.h"		// exp5 complex scenario GPU
 
+#ifndef TAKEN_CELL_NUM
+#define TAKEN_CELL_NUM NUM_CELL
+#endif
+
 extern "C" void runTest();
 
 SocialForceSimApp cloneApp;
@@ -222,6 +226,9 @@ void CTestVisual2Dlg::myDraw()
 	// before draw
 	_memDC.SelectStockObject(NULL_BRUSH);
 	int paintId = cloneApp.paintId;
+#ifdef HOLD_RESIDENT
+	cloneApp.holdResident(paintId);
+#endif
 	SocialForceClone *c = cloneApp.cAll[paintId];
 
 	// draw title
@@ -234,55 +241,66 @@ void CTestVisual2Dlg::myDraw()
 #endif
 
 	// draw passive clone area 
-	for (int i = 0; i < NUM_CELL; i++) {
-		for (int j = 0; j < NUM_CELL; j++) {
-			if (cloneApp.cAll[paintId]->takenMap[i * NUM_CELL + j]) {
+	for (int i = 0; i < TAKEN_CELL_NUM; i++) {
+		for (int j = 0; j < TAKEN_CELL_NUM; j++) {
+			if (cloneApp.cAll[paintId]->takenMap[i * TAKEN_CELL_NUM + j]) {
 				CPen p(PS_SOLID, 0, RGB(240, 240, 240));
 				CBrush b(RGB(240, 240, 240));
 				_memDC.SelectObject(p);
 				_memDC.SelectObject(b);
-				int wscale = screenWidth / NUM_CELL;
-				int hscale = screenHeight / NUM_CELL;
+				int wscale = screenWidth / TAKEN_CELL_NUM;
+				int hscale = screenHeight / TAKEN_CELL_NUM;
 				_memDC.Rectangle(i * wscale, j * hscale, (i + 1) * wscale, (j + 1) * hscale);
 			}
 		}
 	}
 
 	// draw grid
-	int numLine = NUM_CELL;
+	int numLine = TAKEN_CELL_NUM;
 	for (int i = 0; i < numLine; i++) {
 		char rgb = 100;
 		CPen p(PS_DOT, 0, RGB(rgb, rgb, rgb));
 		_memDC.SelectObject(p);
-		_memDC.MoveTo(i * screenWidth / NUM_CELL, 0);
-		_memDC.LineTo(i * screenWidth / NUM_CELL, screenHeight);
-		_memDC.MoveTo(0, i * screenHeight / NUM_CELL);
-		_memDC.LineTo(screenWidth, i * screenHeight / NUM_CELL);
+		_memDC.MoveTo(i * screenWidth / TAKEN_CELL_NUM, 0);
+		_memDC.LineTo(i * screenWidth / TAKEN_CELL_NUM, screenHeight);
+		_memDC.MoveTo(0, i * screenHeight / TAKEN_CELL_NUM);
+		_memDC.LineTo(screenWidth, i * screenHeight / TAKEN_CELL_NUM);
 	}
 
 
 	// draw wall
+#ifdef SHARED_SCENE
+	obstacleLine *walls = c->scene->walls;
+	obstacleLine *gates = c->scene->gates;
+#else
+	obstacleLine *walls = c->walls;
+	obstacleLine *gates = c->gates;
+#endif
 	for (int i = 0; i < NUM_WALLS; i++) {
 		CPen p(PS_SOLID, 5, RGB(0, 0, 0));
 		_memDC.SelectObject(p);
-		double x = c->walls[i].sx / ENV_DIM * screenWidth;
-		double y = c->walls[i].sy / ENV_DIM * screenHeight;
+		double x = walls[i].sx / ENV_DIM * screenWidth;
+		double y = walls[i].sy / ENV_DIM * screenHeight;
 		_memDC.MoveTo(x, y);
-		x = c->walls[i].ex / ENV_DIM * screenWidth;
-		y = c->walls[i].ey / ENV_DIM * screenHeight;
+		x = walls[i].ex / ENV_DIM * screenWidth;
+		y = walls[i].ey / ENV_DIM * screenHeight;
 		_memDC.LineTo(x, y);
 	}
 
 #ifdef DRAW_OBSTACLE
 	// draw gate 
 	for (int i = 0; i < NUM_PARAM; i++) {
+#ifdef SHARED_SCENE
+		if (!c->gateClosed(i))
+			continue;
+#endif
 		CPen p(PS_SOLID, 5, RGB(0, 0, 0));
 		_memDC.SelectObject(p);
-		double x = c->gates[i].sx / ENV_DIM * screenWidth;
-		double y = c->gates[i].sy / ENV_DIM * screenHeight;
+		double x = gates[i].sx / ENV_DIM * screenWidth;
+		double y = gates[i].sy / ENV_DIM * screenHeight;
 		_memDC.MoveTo(x, y);
-		x = c->gates[i].ex / ENV_DIM * screenWidth;
-		y = c->gates[i].ey / ENV_DIM * screenHeight;
+		x = gates[i].ex / ENV_DIM * screenWidth;
+		y = gates[i].ey / ENV_DIM * screenHeight;
 		_memDC.LineTo(x, y);
 	}
 #endif
@@ -294,7 +312,7 @@ void CTestVisual2Dlg::myDraw()
 		uchar4 &color = cloneApp.debugColorHost[i];
 #else
 		SocialForceAgent &ag = *c->context[i];
-		double2& loc = ag.data.loc;
+		double2 loc = make_double2(ag.data.loc.x, ag.data.loc.y);
 		uchar4& color = ag.color;
 #endif
 		CPen p(PS_SOLID, 2, RGB(color.x, color.y, color.z));
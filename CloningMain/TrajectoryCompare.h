@@ -0,0 +1,84 @@
+#ifndef TRAJECTORY_COMPARE_H
+#define TRAJECTORY_COMPARE_H
+
+#include <fstream>
+#include <string>
+#include <vector>
+#include <cmath>
+#include <cstdio>
+
+/* compares two clone trajectories written by SocialForceClone::output(), typically a float or
+mixed precision run against a double run. For every step it reports the largest deviation of
+agent location and velocity over all agents present in both files */
+
+typedef struct {
+	int id;
+	double lx, ly, vx, vy;
+} TrajectoryRecord;
+
+class TrajectoryReader {
+	std::ifstream fin;
+	std::string pending;
+	bool hasPending;
+public:
+	TrajectoryReader(const char *filename) : fin(filename), hasPending(false) {}
+	bool good() { return fin.is_open(); }
+
+	// reads the next step block, returns false at end of file
+	bool nextStep(int &stepCount, std::vector<TrajectoryRecord> &recs) {
+		std::string line;
+		recs.clear();
+		if (hasPending) {
+			line = pending;
+			hasPending = false;
+		}
+		else if (!std::getline(fin, line))
+			return false;
+		if (sscanf(line.c_str(), "========== stepCount: %d", &stepCount) != 1)
+			return false;
+		while (std::getline(fin, line)) {
+			if (line.compare(0, 10, "==========") == 0) {
+				pending = line;
+				hasPending = true;
+				break;
+			}
+			TrajectoryRecord r;
+			if (sscanf(line.c_str(), "%d [%lf,%lf] [%lf, %lf]", &r.id, &r.lx, &r.ly, &r.vx, &r.vy) == 5)
+				recs.push_back(r);
+		}
+		return true;
+	}
+};
+
+// writes "stepCount maxLocErr maxVelErr" per step to reportFile, returns the largest location error
+inline double compareTrajectory(const char *baseFile, const char *testFile, const char *reportFile) {
+	TrajectoryReader base(baseFile), test(testFile);
+	if (!base.good() || !test.good())
+		return -1;
+	std::ofstream report(reportFile);
+	std::vector<TrajectoryRecord> baseRecs, testRecs;
+	int baseStep, testStep;
+	double worst = 0;
+	while (base.nextStep(baseStep, baseRecs) && test.nextStep(testStep, testRecs)) {
+		if (baseStep != testStep)
+			break;
+		double locErr = 0, velErr = 0;
+		size_t n = baseRecs.size() < testRecs.size() ? baseRecs.size() : testRecs.size();
+		for (size_t i = 0; i < n; i++) {
+			const TrajectoryRecord &b = baseRecs[i];
+			const TrajectoryRecord &t = testRecs[i];
+			if (b.id != t.id)
+				continue;
+			double dl = sqrt((b.lx - t.lx) * (b.lx - t.lx) + (b.ly - t.ly) * (b.ly - t.ly));
+			double dv = sqrt((b.vx - t.vx) * (b.vx - t.vx) + (b.vy - t.vy) * (b.vy - t.vy));
+			if (dl > locErr) locErr = dl;
+			if (dv > velErr) velErr = dv;
+		}
+		report << baseStep << " " << locErr << " " << velErr << std::endl;
+		if (locErr > worst) worst = locErr;
+	}
+	report.close();
+	return worst;
+}
+
+#endif
@@ -355,7 +355,7 @@ __device__ void SocialForceAgent::step(){
 
 	//compute force with walls and gates
 	for (int i = 0; i < NUM_WALLS; i++) {
-		obstacleLine wall = myClone->walls[i];
+		obstacleLine wall = sceneDev.walls[i];
 		computeForceWithWall(data, wall, cMass, fSum);
 	}
 
@@ -379,7 +379,7 @@ __device__ void SocialForceAgent::step(){
 
 	double mint = 1;
 	for (int i = 0; i < NUM_WALLS; i++) {
-		obstacleLine wall = myClone->walls[i];
+		obstacleLine wall = sceneDev.walls[i];
 		computeWallImpaction(data, wall, newVelo, tick, mint);
 	}
 
@@ -487,8 +487,8 @@ void SocialForceClone::alterGate(int stepCount) {
 	for (int i = 0; i < NUM_PARAM; i++) {
 		if (cloneParams[i] == stepCount) {
 			changed = true;
-			//gates[i].init(0, 0, 0, 0);
-			//cudaMemcpyAsync(&selfDev->gates[i], &gates[i], sizeof(obstacleLine), cudaMemcpyHostToDevice, myStream);
+			//gateMask &= ~(1ULL << i);
+			//cudaMemcpyAsync(&selfDev->gateMask, &gateMask, sizeof(unsigned long long), cudaMemcpyHostToDevice, myStream);
 		}
 	}
 }
@@ -504,15 +504,11 @@ namespace AppUtil {
 
 		// active cloning condition
 		double2 &loc = agent->data.loc;
+		unsigned long long gateDiff = parentClone->gateMask ^ childClone->gateMask;
 		for (int i = 0; i < NUM_PARAM; i++) {
-			int param1 = parentClone->cloneParams[i];
-			int param2 = childClone->cloneParams[i];
-			if (param1 != param2) {
-				obstacleLine g1 = parentClone->gates[i];
-				obstacleLine g2 = childClone->gates[i];
-				if (g1.pointToLineDist(loc) < 6)
-					return true;
-				if (g2.pointToLineDist(loc) < 6)
+			if ((gateDiff >> i) & 1ULL) {
+				obstacleLine g = sceneDev.gates[i];
+				if (g.pointToLineDist(loc) < 6)
 					return true;
 			}
 		}
@@ -588,20 +584,54 @@ namespace AppUtil {
 		ar[b] = t1;
 	}
 
-	__global__ void reorderKernel(SocialForceClone *c, int numElem) {
-		int idx = threadIdx.x + blockIdx.x * blockDim.x;
-		if (idx == 0) {
-			int l = 0; int r = numElem;
-			int i = l, j = l;
-			for (; j < r; j++) {
-				if (c->ap->takenFlags[j] == true) {
-					swap<SocialForceAgent*>(c->ap->agentPtrArray, i, j);
-					swap<bool>(c->ap->takenFlags, i, j);
-					i++;
-				}
+	/* stable compaction of the pool by takenFlags, run as a single block. Every tile of
+	COMPACT_BLOCK flags is scanned in shared memory, taken agents are scattered to the front
+	and the others to the back of agentPtrScratch, both in their order, then copied back */
+	__global__ void compactKernel(SocialForceClone *c, int numElem) {
+		__shared__ int scan[COMPACT_BLOCK];
+		__shared__ int numKept, keptBase;
+		AgentPool *ap = c->ap;
+		int tid = threadIdx.x;
+		if (tid == 0) {
+			numKept = 0;
+			keptBase = 0;
+		}
+		__syncthreads();
+
+		int kept = 0;
+		for (int i = tid; i < numElem; i += COMPACT_BLOCK)
+			kept += ap->takenFlags[i] ? 1 : 0;
+		atomicAdd(&numKept, kept);
+		__syncthreads();
+
+		for (int tile = 0; tile < numElem; tile += COMPACT_BLOCK) {
+			int i = tile + tid;
+			int flag = (i < numElem && ap->takenFlags[i]) ? 1 : 0;
+			scan[tid] = flag;
+			__syncthreads();
+			for (int offset = 1; offset < COMPACT_BLOCK; offset <<= 1) {
+				int v = tid >= offset ? scan[tid - offset] : 0;
+				__syncthreads();
+				scan[tid] += v;
+				__syncthreads();
 			}
-			c->numElem = i;
+			if (i < numElem) {
+				int rank = scan[tid] - flag;
+				int dst = flag ? keptBase + rank : numKept + i - keptBase - rank;
+				ap->agentPtrScratch[dst] = ap->agentPtrArray[i];
+			}
+			__syncthreads();
+			if (tid == COMPACT_BLOCK - 1)
+				keptBase += scan[tid];
+			__syncthreads();
+		}
+
+		for (int i = tid; i < numElem; i += COMPACT_BLOCK) {
+			ap->agentPtrArray[i] = ap->agentPtrScratch[i];
+			ap->takenFlags[i] = i < numKept;
 		}
+		if (tid == 0)
+			c->numElem = numKept;
 	}
 
 };
@@ -672,8 +702,7 @@ void SocialForceSimApp::compareAndEliminate(SocialForceClone *parentClone, Socia
 	if (childClone->numElem == 0) return;
 	int gSize = GRID_SIZE(childClone->numElem);
 	AppUtil::compareAndEliminateKernel << <gSize, BLOCK_SIZE, 0, childClone->myStream >> >(parentClone->selfDev, childClone->selfDev, childClone->numElem);
-	gSize = GRID_SIZE(NUM_CAP);
-	AppUtil::reorderKernel << <1, 1, 0, childClone->myStream >> >(childClone->selfDev, childClone->numElem);
+	AppUtil::compactKernel << <1, COMPACT_BLOCK, 0, childClone->myStream >> >(childClone->selfDev, childClone->numElem);
 	cudaMemcpyAsync(childClone, childClone->selfDev, sizeof(SocialForceClone), cudaMemcpyDeviceToHost, childClone->myStream);
 	//wchar_t message[20];
 	//swprintf_s(message, 20, L"numElem: %d\n", childClone->numElem);
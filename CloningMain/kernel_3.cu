@@ -299,12 +299,14 @@ __device__ void SocialForceAgent::step(){
 
 	//compute force with walls and gates
 	for (int i = 0; i < NUM_WALLS; i++) {
-		obstacleLine wall = myClone->walls[i];
+		obstacleLine wall = sceneDev.walls[i];
 		computeForceWithWall(data, wall, cMass, fSum);
 	}
 
 	for (int i = 0; i < NUM_PARAM; i++) {
-		obstacleLine &gate = myClone->gates[i];
+		if (!myClone->gateClosed(i))
+			continue;
+		obstacleLine gate = sceneDev.gates[i];
 		if (gate.pointToLineDist(loc) < 6) {
 			// ideally, parent clone agent should compare against all child clone parameter configuration
 			this->flagCloning[i] = -1;
@@ -331,7 +333,7 @@ __device__ void SocialForceAgent::step(){
 
 	double mint = 1;
 	for (int i = 0; i < NUM_WALLS; i++) {
-		obstacleLine wall = myClone->walls[i];
+		obstacleLine wall = sceneDev.walls[i];
 		computeWallImpaction(data, wall, newVelo, tick, mint);
 	}
 
@@ -459,11 +461,12 @@ void SocialForceClone::alterGate(int stepCount) {
 	for (int i = 0; i < NUM_PARAM; i++) {
 		if (cloneParams[i] == stepCount) {
 			changed = true;
-			gates[i].init(0, 0, 0, 0);
-			//cudaMemcpyAsync(&selfDev->gates[i], &gates[i], sizeof(obstacleLine), cudaMemcpyHostToDevice, myStream);
-			cudaMemcpy(&selfDev->gates[i], &gates[i], sizeof(obstacleLine), cudaMemcpyHostToDevice);
+			gateMask &= ~(1ULL << i);
 		}
 	}
+	//cudaMemcpyAsync(&selfDev->gateMask, &gateMask, sizeof(unsigned long long), cudaMemcpyHostToDevice, myStream);
+	if (changed)
+		cudaMemcpy(&selfDev->gateMask, &gateMask, sizeof(unsigned long long), cudaMemcpyHostToDevice);
 }
 
 namespace AppUtil {
@@ -477,15 +480,11 @@ namespace AppUtil {
 
 		// active cloning condition
 		double2 &loc = agent->data.loc;
+		unsigned long long gateDiff = parentClone->gateMask ^ childClone->gateMask;
 		for (int i = 0; i < NUM_PARAM; i++) {
-			int param1 = parentClone->cloneParams[i];
-			int param2 = childClone->cloneParams[i];
-			if (param1 != param2) {
-				obstacleLine g1 = parentClone->gates[i];
-				obstacleLine g2 = childClone->gates[i];
-				if (g1.pointToLineDist(loc) < 6)
-					return true;
-				if (g2.pointToLineDist(loc) < 6)
+			if ((gateDiff >> i) & 1ULL) {
+				obstacleLine g = sceneDev.gates[i];
+				if (g.pointToLineDist(loc) < 6)
 					return true;
 			}
 		}
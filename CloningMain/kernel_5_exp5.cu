@@ -22,9 +22,11 @@ __host__ __device__ bool isInRectSub(double px, double py, double rcx1, double r
 	double yr = (py - rcy1) * (py - rcy2);
 	return (xr <= 0 && yr <= 0);
 }
-__host__ __device__ bool isInRects(double &px, double &py, obstacleLine *gates) {
+__host__ __device__ bool isInRects(double &px, double &py, const obstacleLine *gates, unsigned long long gateMask) {
 
 	for (int i = 0; i < NUM_PARAM / 4; i++) {
+		if (((gateMask >> (4 * i)) & 1ULL) == 0)
+			continue;
 		if (isInRectSub(px, py, gates[4 * i + 2].sx, gates[4 * i].sy, gates[4 * i + 2].ex, gates[4 * i].ey))
 			return true;
 	}
@@ -245,11 +247,13 @@ __device__ void SocialForceAgent::step(){
 
 	//compute force with walls and gates
 	for (int i = 0; i < NUM_WALLS; i++) {
-		obstacleLine wall = myClone->walls[i];
+		obstacleLine wall = sceneDev.walls[i];
 		computeForceWithWall(data, wall, cMass, fSum);
 	}
 	for (int i = 0; i < NUM_PARAM; i++) {
-		obstacleLine gate = myClone->gates[i];
+		if (!myClone->gateClosed(i))
+			continue;
+		obstacleLine gate = sceneDev.gates[i];
 		computeForceWithWall(data, gate, cMass, fSum);
 	}
 
@@ -273,11 +277,13 @@ __device__ void SocialForceAgent::step(){
 
 	double mint = 1;
 	for (int i = 0; i < NUM_WALLS; i++) {
-		obstacleLine wall = myClone->walls[i];
+		obstacleLine wall = sceneDev.walls[i];
 		computeWallImpaction(data, wall, newVelo, tick, mint);
 	}
 	for (int i = 0; i < NUM_PARAM; i++) {
-		obstacleLine gate = myClone->gates[i];
+		if (!myClone->gateClosed(i))
+			continue;
+		obstacleLine gate = sceneDev.gates[i];
 		computeWallImpaction(data, gate, newVelo, tick, mint);
 	}
 
@@ -316,7 +322,7 @@ __device__ void SocialForceAgent::init(SocialForceClone* c, int idx) {
 	dataLocal.loc.x = (0.3 + 0.4 * curand_uniform(&rStateLocal)) * ENV_DIM;
 	dataLocal.loc.y = (0.3 + 0.4 * curand_uniform(&rStateLocal)) * ENV_DIM;
 
-	while (isInRects(dataLocal.loc.x, dataLocal.loc.y, myClone->gates)) {
+	while (isInRects(dataLocal.loc.x, dataLocal.loc.y, sceneDev.gates, myClone->gateMask)) {
 		dataLocal.loc.x = (0.3 + 0.4 * curand_uniform(&rStateLocal)) * ENV_DIM;
 		dataLocal.loc.y = (0.3 + 0.4 * curand_uniform(&rStateLocal)) * ENV_DIM;
 	}
@@ -377,8 +383,8 @@ void SocialForceClone::alterGate(int stepCount) {
 	for (int i = 0; i < NUM_PARAM; i++) {
 		if (cloneParams[i] == stepCount) {
 			changed = true;
-			//gates[i].init(0, 0, 0, 0);
-			//cudaMemcpyAsync(&selfDev->gates[i], &gates[i], sizeof(obstacleLine), cudaMemcpyHostToDevice, myStream);
+			//gateMask &= ~(1ULL << i);
+			//cudaMemcpyAsync(&selfDev->gateMask, &gateMask, sizeof(unsigned long long), cudaMemcpyHostToDevice, myStream);
 		}
 	}
 }
@@ -394,15 +400,11 @@ namespace AppUtil {
 
 		// active cloning condition
 		double2 &loc = agent->data.loc;
+		unsigned long long gateDiff = parentClone->gateMask ^ childClone->gateMask;
 		for (int i = 0; i < NUM_PARAM; i++) {
-			int param1 = parentClone->cloneParams[i];
-			int param2 = childClone->cloneParams[i];
-			if (param1 != param2) {
-				obstacleLine g1 = parentClone->gates[i];
-				obstacleLine g2 = childClone->gates[i];
-				if (g1.pointToLineDist(loc) < 6)
-					return true;
-				if (g2.pointToLineDist(loc) < 6)
+			if ((gateDiff >> i) & 1ULL) {
+				obstacleLine g = sceneDev.gates[i];
+				if (g.pointToLineDist(loc) < 6)
 					return true;
 			}
 		}
@@ -9,7 +9,6 @@
 //#include "socialForce.cuh"
 #include "socialForceEnhanced.cuh"
 int main(int argc, char *argv[]){
-	srand(time(0));
 	//argv[1]: config.txt
 	//argv[2]: numAgent
 	//argv[3]: clone chosen to demonstrate, declared in SocialForceEnhanced.cuh
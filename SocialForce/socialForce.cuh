@@ -227,11 +227,10 @@ public:
 
 		double *gateSizesHost = (double*)malloc(sizeof(double) * NUM_CLONE);
 		uchar4 *colorsHost = (uchar4*)malloc(sizeof(uchar4) * NUM_CLONE);
-		srand(time(NULL));
 		for (int i = 0; i < NUM_CLONE; i++) {
 			gateSizesHost[i] = i * 2 + 4;
-			int r = rand();
-			memcpy(&colorsHost[i], &r, sizeof(uchar4));
+			uint4 r = util::randomBits(modelHostParams.RANDOM_SEED, i, 0, 0);
+			memcpy(&colorsHost[i], &r.x, sizeof(uchar4));
 		}
 
 		cudaMemcpyToSymbol(gateSizes, &gateSizesHost[0], NUM_CLONE * sizeof(double));
@@ -265,7 +264,7 @@ public:
 		util::hostAllocCopyToDevice<GWorld>(worldHost, &world);
 
 		//init utility
-		randomHost = new GRandom(modelHostParams.MAX_AGENT_NO);
+		randomHost = new GRandom();
 		util::hostAllocCopyToDevice<GRandom>(randomHost, &random);
 
 		util::hostAllocCopyToDevice<SocialForceModel>(this, (SocialForceModel**)&this->model);
@@ -961,8 +960,8 @@ public:
 
 		dataLocal.agentPtr = this;
 #ifdef NDEBUG
-		dataLocal.loc.x = (0.25 + 0.5 * this->random->uniform()) * modelDevParams.WIDTH - 0.1;
-		dataLocal.loc.y = this->random->uniform() * modelDevParams.HEIGHT;
+		dataLocal.loc.x = (0.25 + 0.5 * this->random->uniform(dataSlot, 0)) * modelDevParams.WIDTH - 0.1;
+		dataLocal.loc.y = this->random->uniform(dataSlot, 1) * modelDevParams.HEIGHT;
 #else
 		double sqrtNumAgent = sqrt((double)numAgent);
 		double x = (double)(dataSlot % (int)sqrtNumAgent) / sqrtNumAgent;
@@ -0,0 +1,45 @@
+#ifndef GSIMBOUNDARY_H
+#define GSIMBOUNDARY_H
+#include "inc/helper_math.h"
+
+/* what the edge of the world does, chosen at compile time with GWORLD_BOUNDARY. Clamp keeps an
+agent just inside the edge and the neighbor queries stop there. Periodic makes the world a torus:
+positions wrap, the distances are minimum images and the host queries walk ghost cells past the
+edge that stand for the cells on the other side, the device queries do not (see gsimcore.cuh).
+Reflective mirrors a position at the edge */
+#define BOUNDARY_CLAMP 0
+#define BOUNDARY_PERIODIC 1
+#define BOUNDARY_REFLECT 2
+#ifndef GWORLD_BOUNDARY
+#define GWORLD_BOUNDARY BOUNDARY_CLAMP
+#endif
+
+namespace util{
+	// a position brought back into [0, dim)
+	template<class T> __host__ __device__ inline T boundPos(T x, T dim) {
+#if GWORLD_BOUNDARY == BOUNDARY_PERIODIC
+		x = x - dim * floor(x / dim);
+		return x < dim ? x : 0;
+#elif GWORLD_BOUNDARY == BOUNDARY_REFLECT
+		x = x - 2 * dim * floor(x / (2 * dim));
+		x = x < dim ? x : 2 * dim - x;
+		return x < dim ? x : dim - (T)0.001;
+#else
+		if (x >= dim)
+			return dim - (T)0.001;
+		else if (x < 0)
+			return 0;
+		return x;
+#endif
+	}
+	// the displacement d between two positions as the model sees it, without a branch per pair
+	template<class T> __host__ __device__ inline T boundDelta(T d, T dim) {
+#if GWORLD_BOUNDARY == BOUNDARY_PERIODIC
+		return d - dim * floor(d / dim + (T)0.5);
+#else
+		return d;
+#endif
+	}
+};
+
+#endif
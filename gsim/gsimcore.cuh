@@ -1,6 +1,12 @@
 #ifndef GSIMCORE_H
 #define GSIMCORE_H
 #include "gsimlib_header.cuh"
+#include "gsimoutput.h"
+
+// the warp wide cell range of neighborQueryInit stops at the edge, wrapped neighbors would be missed
+#if GWORLD_BOUNDARY == BOUNDARY_PERIODIC
+#error gsimcore.cuh supports BOUNDARY_CLAMP and BOUNDARY_REFLECT only, periodic worlds run on gsimhost.h
+#endif
 
 #define GSIM_DEBUG
 
@@ -37,8 +43,6 @@ namespace util{
 	void genNeighbor(GWorld *world, GWorld *world_h, int numAgent);
 
 	template<class Type> void hostAllocCopyToDevice(Type *hostPtr, Type **devicePtr);
-	__device__ int zcode(int x, int y);
-	__device__ int zcode(int x, int y, int z);
 };
 namespace agentPoolUtil{
 	//poolUtil implementation
@@ -54,21 +58,16 @@ namespace agentPoolUtil{
 			delMark[idx] = true;
 		}
 	}
-	/*kernel func: numElem = numElem + incCount - decCount; no need to be called*/
-	template<class Agent, class AgentData> 
-	__global__ void genHash(AgentPool<Agent, AgentData> *pDev, int *worldHash) {
-		int idx = threadIdx.x + blockIdx.x * blockDim.x;
-		if (idx < pDev->numElemMax) {
-			bool del = pDev->delMark[idx];
-			Agent *o = pDev->agentPtrArray[idx];
-			if (del == false) {
-				worldHash[idx] = o->locHash();
-			}
+
+	/*predicate of cleanup: the (agentPtr, dataIdx, delMark) slot holds a live agent*/
+	struct slotAlive {
+		__host__ __device__ bool operator()(const thrust::tuple<void*, int, int> &slot) const {
+			return thrust::get<2>(slot) == false;
 		}
-	}
+	};
 
-	template<class Agent>
-	__global__ void stepKernel(int numElem, Agent **agentPtrArray, GModel *model)
+	template<class Agent, class Model>
+	__global__ void stepKernel(int numElem, Agent **agentPtrArray, Model *model)
 	{
 		int idx = threadIdx.x + blockIdx.x * blockDim.x; 
 		if (idx < numElem) {
@@ -114,9 +113,14 @@ public:
 	}
 	__device__ int locHash() {
 		FLOATn myLoc = this->data->loc;
-		int xhash = (int)(myLoc.x/modelDevParams.CLEN_X);
-		int yhash = (int)(myLoc.y/modelDevParams.CLEN_Y);
+		int xhash = util::cellOf(myLoc.x, modelDevParams.CLEN_X, modelDevParams.CNO_PER_DIM);
+		int yhash = util::cellOf(myLoc.y, modelDevParams.CLEN_Y, modelDevParams.CNO_PER_DIM);
+#ifdef GWORLD_3D
+		int zhash = util::cellOf(myLoc.z, modelDevParams.CLEN_Z, modelDevParams.CNO_PER_DIM_Z);
+		return util::cellZcode(xhash, yhash, zhash);
+#else
 		return util::zcode(xhash, yhash);
+#endif
 	}
 };
 
@@ -137,6 +141,9 @@ public:
 	__host__ GWorld(){
 		this->width = modelHostParams.WIDTH;
 		this->height = modelHostParams.HEIGHT;
+#ifdef GWORLD_3D
+		this->depth = modelHostParams.DEPTH;
+#endif
 		this->numAgentWorld = 0;
 		size_t sizeCellArray = modelHostParams.CELL_NO*sizeof(int);
 
@@ -163,11 +170,10 @@ public:
 		this->width = w;
 		this->height = h;
 		this->depth = d;
-		size_t sizeAgArray = MAX_AGENT_NO*sizeof(int);
-		size_t sizeCellArray = CELL_NO*sizeof(int);
+		this->numAgentWorld = 0;
+		size_t sizeCellArray = modelHostParams.CELL_NO*sizeof(int);
 
-		cudaMalloc((void**)&this->allAgents, MAX_AGENT_NO*sizeof(GAgent*));
-		cudaMalloc((void**)&neighborIdx, sizeAgArray);
+		cudaMalloc((void**)&this->allAgents, modelHostParams.MAX_AGENT_NO*sizeof(GAgent*));
 		cudaMalloc((void**)&cellIdxStart, sizeCellArray);
 		cudaMalloc((void**)&cellIdxEnd, sizeCellArray);
 	}
@@ -199,47 +205,56 @@ public:
 	__host__ virtual void preStep() = 0;
 	__host__ virtual void step() = 0;
 	__host__ virtual void stop() = 0;
+	// loop thread, after step: what the output stage gets of this step
+	__host__ virtual void snapshot(GStepRecord &rec) {}
+	// output thread, the records in step order while the following steps run
+	__host__ virtual void consume(const GStepRecord &rec) {}
+};
+
+/* static model: Model derives from GModelT<Model> and has start, preStep, step and stop as
+plain members. doLoop<Model> and stepPoolAgent<Model> call them and Agent::step(Model*)
+directly, so the step of an agent is inlined into the loop of the pool. GModelAdapter gives
+such a model the virtual GModel interface for code that holds a GModel* */
+template<class Model> class GModelT
+{
+public:
+	Model *model;	// device copy, as GModel::model
+public:
+	__host__ void snapshot(GStepRecord &rec) {}
+	__host__ void consume(const GStepRecord &rec) {}
 };
 
-__global__ void initRandom(GRandom *random, int nElemMax);
+template<class Model> class GModelAdapter : public GModel
+{
+	Model *m;
+public:
+	__host__ GModelAdapter(Model *m) : m(m) {
+		this->model = NULL; // agents of a static model get m->model
+	}
+	__host__ void start() { m->start(); }
+	__host__ void preStep() { m->preStep(); }
+	__host__ void step() { m->step(); }
+	__host__ void stop() { m->stop(); }
+	__host__ void snapshot(GStepRecord &rec) { m->snapshot(rec); }
+	__host__ void consume(const GStepRecord &rec) { m->consume(rec); }
+};
+
+/* stateless, a draw is keyed by (seed, contextId, stepCount, stream), see gsimrandom.h. The
+agent passes its own id as contextId, the draws no longer follow the thread index */
 class GRandom {
-	curandState_t *rState;
+	unsigned int seed;
 public:
-	__host__ GRandom(int nElemMax) {
-		printf("GRandom size: %d\n", sizeof(curandState_t));
-		cudaMalloc((void**)&rState, nElemMax * sizeof(curandState_t));
-		GRandom *devSelf;
-		util::hostAllocCopyToDevice<GRandom>(this, &devSelf);
-		int gSize = GRID_SIZE(nElemMax);
-		initRandom<<<gSize, BLOCK_SIZE>>>(devSelf, nElemMax);
-		cudaFree(devSelf);
+	__host__ GRandom() {
+		seed = modelHostParams.RANDOM_SEED;
 	}
-	__host__ ~GRandom()
-	{
-		cudaFree(rState);
+	__device__ float uniform(int contextId, int stream){
+		return util::randomUniform(util::randomBits(seed, contextId, stepCount, stream).x);
 	}
-	__device__ void init(){
-		int idx = threadIdx.x + blockIdx.x * blockDim.x;
-		curand_init(modelDevParams.RANDOM_SEED, idx, 0, &this->rState[idx]);
-	}
-	__device__ float uniform(){
-		int idx = threadIdx.x + blockIdx.x * blockDim.x;
-		float res = curand_uniform(&rState[idx]);
-		return res;
-	}
-	__device__ float gaussian(){
-		int idx = threadIdx.x + blockIdx.x * blockDim.x;
-		return curand_normal(&this->rState[idx]);
+	__device__ float gaussian(int contextId, int stream){
+		uint4 bits = util::randomBits(seed, contextId, stepCount, stream);
+		return util::randomGaussian(bits.x, bits.y);
 	}
-	friend __global__ void initRandom(GRandom *random, int nElemMax);
 };
-__global__ void initRandom(GRandom *random, int nElemMax)
-{
-	int idx = threadIdx.x + blockIdx.x * blockDim.x;
-	if (idx < nElemMax)	{
-		curand_init(modelDevParams.RANDOM_SEED, idx, 0, &random->rState[idx]);
-	}
-}
 
 template<class Agent, class AgentData> class AgentPool
 {
@@ -256,6 +271,8 @@ public:
 	unsigned int numElemMax;
 	unsigned int incCount;
 	unsigned int decCount;
+	/* lowest slot removed since the last cleanup, the slots below it are all live */
+	unsigned int dirtyBegin;
 	/* keeping the actual Agents */
 	Agent **agentPtrArray;
 	/* Agent array*/
@@ -293,8 +310,10 @@ public:
 	__device__ void remove(int agentSlot)
 	{
 		bool del = atomicCAS(&this->delMark[agentSlot], false, true);
-		if (del == false) 
+		if (del == false) {
 			atomicInc(&decCount, numElem);
+			atomicMin(&dirtyBegin, agentSlot);
+		}
 
 		this->modified = true;
 	}
@@ -304,6 +323,7 @@ public:
 		this->numElemMax = nElemMax;
 		this->incCount = 0;
 		this->decCount = 0;
+		this->dirtyBegin = 0; // the first nElem slots are filled by add directly, none is known live
 		this->modified = false;
 		cudaMalloc((void**)&this->delMark, nElemMax * sizeof(int));
 		cudaMalloc((void**)&this->agentArray, nElemMax * sizeof(Agent));
@@ -321,10 +341,21 @@ public:
 		typedef thrust::device_ptr<int> tdp_int;
 		cudaMemcpy(this, pDev, sizeof(AgentPool<Agent, AgentData>), cudaMemcpyDeviceToHost);
 
+		/* after a cleanup the slots below numElem are live and the rest are free. A step only
+		removes from dirtyBegin on and adds from numElem to numElem + incCount, only that range
+		is compacted, its partition point is the new numElem. A pool without change costs
+		nothing but the two copies of the pool struct */
+		unsigned int begin = min(this->dirtyBegin, this->numElem);
+		unsigned int end = min(this->numElem + this->incCount, this->numElemMax);
 		this->incCount = 0;
 		this->decCount = 0;
+		this->dirtyBegin = this->numElemMax;
 		bool poolModifiedLocal = this->modified;
 		this->modified = false;
+		if (begin >= end) {
+			cudaMemcpy(pDev, this, sizeof(AgentPool<Agent, AgentData>), cudaMemcpyHostToDevice);
+			return poolModifiedLocal && this->numElem > 0;
+		}
 
 		int *dataIdxArrayLocal = this->dataIdxArray;
 		int *delMarkLocal = this->delMark;
@@ -333,25 +364,18 @@ public:
 		tdp_int thrustDelMark = thrust::device_pointer_cast(delMarkLocal);
 		tdp_voidStar thrustAgentPtrArray = thrust::device_pointer_cast(agentPtrArrayLocal);
 		tdp_int thrustDataIdxArray = thrust::device_pointer_cast(dataIdxArrayLocal);
-		tdp_int thrustHash = thrust::device_pointer_cast(worldHash);
 
-		this->numElem = this->numElemMax - thrust::reduce(thrustDelMark, thrustDelMark + this->numElemMax);
-		if (this->numElem == 0)
-			return false;
-		
-		int gSize = GRID_SIZE(this->numElemMax);
-		agentPoolUtil::genHash<<<gSize, BLOCK_SIZE>>>(pDev, worldHash);
-
-		thrust::tuple<tdp_voidStar, tdp_int> val = thrust::make_tuple(thrustAgentPtrArray, thrustDataIdxArray);
-		thrust::tuple<tdp_int, tdp_int> key = thrust::make_tuple(thrustDelMark, thrustHash);
-		thrust::zip_iterator< thrust::tuple<tdp_voidStar, tdp_int> > valFirst = thrust::make_zip_iterator(val);
-		thrust::zip_iterator< thrust::tuple<tdp_int, tdp_int> > keyFirst = thrust::make_zip_iterator(key);
-		thrust::sort_by_key(keyFirst, keyFirst + this->numElemMax, valFirst);
+		/* stable compaction: live slots move to the front keeping their order, the freed slots
+		(and their data indices) to the back. The spatial order comes from the hash sort of the
+		world in util::genNeighbor, so the pool does not sort by hash itself */
+		thrust::tuple<tdp_voidStar, tdp_int, tdp_int> slot = thrust::make_tuple(thrustAgentPtrArray, thrustDataIdxArray, thrustDelMark);
+		thrust::zip_iterator< thrust::tuple<tdp_voidStar, tdp_int, tdp_int> > slotFirst = thrust::make_zip_iterator(slot);
+		this->numElem = thrust::stable_partition(slotFirst + begin, slotFirst + end, agentPoolUtil::slotAlive()) - slotFirst;
 
 		cudaMemcpy(pDev, this, sizeof(AgentPool<Agent, AgentData>), cudaMemcpyHostToDevice);
 		//}
 
-		return poolModifiedLocal; 
+		return poolModifiedLocal && this->numElem > 0; 
 	}
 	__host__ void registerPool(GWorld *worldHost, GScheduler *schedulerHost, AgentPool<Agent, AgentData> *pDev)
 	{
@@ -382,7 +406,9 @@ public:
 		int gSize = GRID_SIZE(nElemMax);
 		agentPoolUtil::initPoolIdxArray<<<gSize, BLOCK_SIZE>>>(dataIdxArray, delMark, nElemMax);
 	}
-	__host__ int stepPoolAgent(GModel *model, cudaStream_t poolStream)
+	// Model is GModel or, for a static model, the model class itself
+	template<class Model>
+	__host__ int stepPoolAgent(Model *model, cudaStream_t poolStream)
 	{
 		if (numElem <= 0)
 			return 0;
@@ -400,51 +426,23 @@ __device__ GAgent* GWorld::obtainAgent(int idx) const {
 	} 
 	return ag;
 }
+// positions and distances under GWORLD_BOUNDARY, see gsimboundary.h
 __device__ float GWorld::stx(float x, float width) const{
-	if (x >= 0) {
-		if (x >= width)
-			x = x - width;
-	} else
-		x = x + width;
-	return x;
+	return util::boundPos(x, width);
 }
 __device__ float GWorld::sty(float y, float height) const {
-	if (y >= 0) {
-		if (y >= height)
-			y = y - height;
-	} else
-		y = y + height;
-	return y;
-
+	return util::boundPos(y, height);
 }
 __device__ float GWorld::tdx(float ax, float bx) const {
-	float width = this->width;
-	if(fabs(ax - bx) <= width / 2)
-		return ax - bx;
-
-	float dx = stx(ax, width) - stx(bx, width);
-	if (dx * 2 > width)
-		return dx - width;
-	if (dx * 2 < -width)
-		return dx + width;
-	return 0;
+	return util::boundDelta(ax - bx, this->width);
 }
 __device__ float GWorld::tdy(float ay, float by) const {
-	float height = this->height;
-	if(fabs(ay - by) <= height / 2)
-		return ay - by;
-
-	float dy = stx(ay, height) - stx(by, height);
-	if (dy * 2 > height)
-		return dy - height;
-	if (dy * 2 < - height)
-		return dy + height;
-	return 0;
+	return util::boundDelta(ay - by, this->height);
 }
-__device__ int sharedMin(volatile int* data, int tid, int idx, float loc, float range, float discr)
+// cell bounds of a query, clamped as in locHash and reduced over the warp
+__device__ int sharedMin(volatile int* data, int tid, int idx, float loc, float range, float discr, int cno)
 {
-	int index = (int)((loc-range)/discr);
-	if (index < 0) index = 0;
+	int index = util::cellOf(loc - range, discr, cno);
 	int lane = tid & 31;
 	int wid = tid >> 5;
 	//__syncthreads();
@@ -456,10 +454,9 @@ __device__ int sharedMin(volatile int* data, int tid, int idx, float loc, float
 	if (lane >= 16) if(data[tid] < data[tid-16]) data[tid-16] = data[tid];
 	return data[wid * warpSize];
 }
-__device__ int sharedMax(volatile int* data, int tid, int idx, float loc, float range, float discr)
+__device__ int sharedMax(volatile int* data, int tid, int idx, float loc, float range, float discr, int cno)
 {
-	int index = (int)((loc+range)/discr);
-	if (index >= modelDevParams.CNO_PER_DIM) index = modelDevParams.CNO_PER_DIM - 1;
+	int index = util::cellOf(loc + range, discr, cno);
 	int lane = tid & 31;
 	int wid = tid >> 5;
 	//__syncthreads();
@@ -479,13 +476,13 @@ __device__ void GWorld::neighborQueryInit(const FLOATn &agLoc, float range, iter
 	info.boarder = -1;
 	info.ptrInSmem = 0;
 
-	info.cellHead.x = sharedMin(gsimSmem, tid, idx, agLoc.x, range, modelDevParams.CLEN_X);
-	info.cellTail.x = sharedMax(gsimSmem, tid, idx, agLoc.x, range, modelDevParams.CLEN_X);
-	info.cellHead.y = sharedMin(gsimSmem, tid, idx, agLoc.y, range, modelDevParams.CLEN_Y);
-	info.cellTail.y = sharedMax(gsimSmem, tid, idx, agLoc.y, range, modelDevParams.CLEN_Y);
+	info.cellHead.x = sharedMin(gsimSmem, tid, idx, agLoc.x, range, modelDevParams.CLEN_X, modelDevParams.CNO_PER_DIM);
+	info.cellTail.x = sharedMax(gsimSmem, tid, idx, agLoc.x, range, modelDevParams.CLEN_X, modelDevParams.CNO_PER_DIM);
+	info.cellHead.y = sharedMin(gsimSmem, tid, idx, agLoc.y, range, modelDevParams.CLEN_Y, modelDevParams.CNO_PER_DIM);
+	info.cellTail.y = sharedMax(gsimSmem, tid, idx, agLoc.y, range, modelDevParams.CLEN_Y, modelDevParams.CNO_PER_DIM);
 #ifdef GWORLD_3D
-	info.cellHead.z = sharedMin(gsimSmem, tid, idx, agLoc.z, range, modelDevParams.CLEN_Z);
-	info.cellTail.z = sharedMin(gsimSmem, tid, idx, agLoc.z, range, modelDevParams.CLEN_Z);
+	info.cellHead.z = sharedMin(gsimSmem, tid, idx, agLoc.z, range, modelDevParams.CLEN_Z, modelDevParams.CNO_PER_DIM_Z);
+	info.cellTail.z = sharedMax(gsimSmem, tid, idx, agLoc.z, range, modelDevParams.CLEN_Z, modelDevParams.CNO_PER_DIM_Z);
 #endif
 
 	info.cellCur.x = info.cellHead.x;
@@ -512,7 +509,7 @@ __device__ void GWorld::neighborQueryReset(iterInfo &info) const{
 }
 __device__ void GWorld::calcPtrAndBoarder(iterInfo &info) const {
 #ifdef GWORLD_3D
-	int worldHash = util::zcode(info.cellCur.x, info.cellCur.y, info.cellCur.z);
+	int worldHash = util::cellZcode(info.cellCur.x, info.cellCur.y, info.cellCur.z);
 #else
 	int worldHash = util::zcode(info.cellCur.x, info.cellCur.y);
 #endif
@@ -608,22 +605,10 @@ template<class dataUnion> __device__ void GWorld::setSMem(iterInfo &info) const
 }
 #ifdef GWORLD_3D
 __device__ float GWorld::stz(const float z) const{
-	float res = z;
-	if (z >= 0) {
-		if (z >= this->depth)
-			res = z - this->depth;
-	} else
-		res = z + this->depth;
-	if (res == this->depth)
-		res = 0;
-	return res;
+	return util::boundPos(z, this->depth);
 }
 __device__ float GWorld::tdz(float az, float bz) const {
-	float dz = abs(az-bz);
-	if (dz < this->depth / 2)
-		return dz;
-	else
-		return this->depth - dz;
+	return util::boundDelta(az - bz, this->depth);
 }
 #endif
 
@@ -693,135 +678,7 @@ template<class Type> void util::hostAllocCopyToDevice(Type *hostPtr, Type **devP
 	cudaMemcpy(*devPtr, hostPtr, size, cudaMemcpyHostToDevice);
 	getLastCudaError("copyHostToDevice");
 }
-__device__ int util::zcode(int x, int y)
-{
-	x &= 0x0000ffff;					// x = ---- ---- ---- ---- fedc ba98 7654 3210
-	y &= 0x0000ffff;					// x = ---- ---- ---- ---- fedc ba98 7654 3210
-	x = (x ^ (x << 8)) & 0x00ff00ff; // x = ---- ---- fedc ba98 ---- ---- 7654 3210
-	y = (y ^ (y << 8)) & 0x00ff00ff; // x = ---- ---- fedc ba98 ---- ---- 7654 3210
-	y = (y ^ (y << 4)) & 0x0f0f0f0f; // x = ---- fedc ---- ba98 ---- 7654 ---- 3210
-	x = (x ^ (x << 4)) & 0x0f0f0f0f; // x = ---- fedc ---- ba98 ---- 7654 ---- 3210
-	y = (y ^ (y << 2)) & 0x33333333; // x = --fe --dc --ba --98 --76 --54 --32 --10
-	x = (x ^ (x << 2)) & 0x33333333; // x = --fe --dc --ba --98 --76 --54 --32 --10
-	y = (y ^ (y << 1)) & 0x55555555; // x = -f-e -d-c -b-a -9-8 -7-6 -5-4 -3-2 -1-0
-	x = (x ^ (x << 1)) & 0x55555555; // x = -f-e -d-c -b-a -9-8 -7-6 -5-4 -3-2 -1-0
-	return x | (y << 1);
-}
-__device__ int util::zcode(int x, int y, int z)
-{
-	x &= 0x000003ff;                  // x = ---- ---- ---- ---- ---- --98 7654 3210
-	x = (x ^ (x << 16)) & 0xff0000ff; // x = ---- --98 ---- ---- ---- ---- 7654 3210
-	x = (x ^ (x <<  8)) & 0x0300f00f; // x = ---- --98 ---- ---- 7654 ---- ---- 3210
-	x = (x ^ (x <<  4)) & 0x030c30c3; // x = ---- --98 ---- 76-- --54 ---- 32-- --10
-	x = (x ^ (x <<  2)) & 0x09249249; // x = ---- 9--8 --7- -6-- 5--4 --3- -2-- 1--0
-
-	y &= 0x000003ff;                  // y = ---- ---- ---- ---- ---- --98 7654 3210
-	y = (y ^ (y << 16)) & 0xff0000ff; // y = ---- --98 ---- ---- ---- ---- 7654 3210
-	y = (y ^ (y <<  8)) & 0x0300f00f; // y = ---- --98 ---- ---- 7654 ---- ---- 3210
-	y = (y ^ (y <<  4)) & 0x030c30c3; // y = ---- --98 ---- 76-- --54 ---- 32-- --10
-	y = (y ^ (y <<  2)) & 0x09249249; // y = ---- 9--8 --7- -6-- 5--4 --3- -2-- 1--0
-
-	z &= 0x000003ff;                  // z = ---- ---- ---- ---- ---- --98 7654 3210
-	z = (z ^ (z << 16)) & 0xff0000ff; // z = ---- --98 ---- ---- ---- ---- 7654 3210
-	z = (z ^ (z <<  8)) & 0x0300f00f; // z = ---- --98 ---- ---- 7654 ---- ---- 3210
-	z = (z ^ (z <<  4)) & 0x030c30c3; // z = ---- --98 ---- 76-- --54 ---- 32-- --10
-	z = (z ^ (z <<  2)) & 0x09249249; // z = ---- 9--8 --7- -6-- 5--4 --3- -2-- 1--0
-	return (z << 2) | (y << 1) | x;
-}
-
 //execution logic
-void readConfig(char *config_file){
-	std::ifstream fin;
-	fin.open(config_file);
-	std::string rec;
-	char *cstr, *p;
-	cstr = (char *)malloc(100 * sizeof(char));
-
-
-	int discr = 0;
-
-	while (!fin.eof()) {
-		std::getline(fin, rec);
-		std::strcpy(cstr, rec.c_str());
-		if(strcmp(cstr,"")==0)
-			break;
-		p=strtok(cstr, "=");
-		if(strcmp(p, "AGENT_NO")==0){
-			p=strtok(NULL, "=");
-			modelHostParams.AGENT_NO = atoi(p);
-		}
-		if(strcmp(p, "MAX_AGENT_NO")==0){
-			p=strtok(NULL, "=");
-			modelHostParams.MAX_AGENT_NO = atoi(p);
-		}
-		if(strcmp(p, "WIDTH")==0){
-			p=strtok(NULL, "=");
-			modelHostParams.WIDTH = atoi(p);
-		}
-		if(strcmp(p, "HEIGHT")==0){
-			p=strtok(NULL, "=");
-			modelHostParams.HEIGHT = atoi(p);
-		}
-		if(strcmp(p, "DEPTH")==0){
-			p=strtok(NULL, "=");
-			modelHostParams.DEPTH = atoi(p);
-		}
-		if(strcmp(p, "DISCRETI")==0){
-			p=strtok(NULL, "=");
-			discr = atoi(p);
-		}
-		if(strcmp(p, "STEPS")==0){
-			p=strtok(NULL, "=");
-			STEPS = atoi(p);
-		}
-		if(strcmp(p, "VISUALIZE")==0){
-			p=strtok(NULL, "=");
-			VISUALIZE = atoi(p);
-		}
-		if(strcmp(p, "BLOCK_SIZE")==0){
-			p=strtok(NULL, "=");
-			BLOCK_SIZE = atoi(p);
-		}
-		if(strcmp(p, "HEAP_SIZE")==0){
-			p=strtok(NULL, "=");
-			HEAP_SIZE = atoi(p);
-		}
-		if(strcmp(p, "STACK_SIZE")==0){
-			p=strtok(NULL, "=");
-			STACK_SIZE = atoi(p);
-		}
-		if(strcmp(p, "RANDOM_SEED")==0){
-			p=strtok(NULL, "=");
-			int randomSeed = atoi(p);
-		}
-	}
-	free(cstr);
-	fin.close();
-
-	modelHostParams.CNO_PER_DIM = (int)pow((float)2, discr);
-	modelHostParams.CELL_NO = modelHostParams.CNO_PER_DIM * modelHostParams.CNO_PER_DIM;
-	modelHostParams.CLEN_X = modelHostParams.WIDTH/modelHostParams.CNO_PER_DIM;
-	modelHostParams.CLEN_Y = modelHostParams.HEIGHT/modelHostParams.CNO_PER_DIM;
-
-#ifdef GWORLD_3D
-	CELL_NO *= CNO_PER_DIM_H;
-	float modelHostParams.CLEN_Z = DEPTH_H/(float)CNO_PER_DIM_H;
-#endif
-
-	printf("model params:\n");
-	printf("\tmodelHostParams.AGENT_NO:%d\n", modelHostParams.AGENT_NO);
-	printf("\tmodelHostParams.CELL_NO:%d\n", modelHostParams.CELL_NO);
-	printf("\tmodelHostParams.CLEN_X:%f\n", modelHostParams.CLEN_X);
-	printf("\tmodelHostParams.CLEN_Y:%f\n", modelHostParams.CLEN_Y);
-	printf("\tmodelHostParams.CLEN_Z:%f\n", modelHostParams.CLEN_Z);
-	printf("\tmodelHostParams.CNO_PER_DIM:%d\n", modelHostParams.CNO_PER_DIM);
-	printf("\tmodelHostParams.WIDTH:%f\n", modelHostParams.WIDTH);
-	printf("\tmodelHostParams.DEPTH:%f\n", modelHostParams.DEPTH);
-	printf("\tmodelHostParams.HEIGHT:%f\n", modelHostParams.HEIGHT);
-	printf("\tmodelHostParams.MAX_AGENT_NO:%d\n", modelHostParams.MAX_AGENT_NO);
-
-	cudaMemcpyToSymbol(modelDevParams, &modelHostParams, sizeof(modelConstants));
-}
 size_t sizeOfSmem = 0;
 template<class SharedMemoryData> void init(char *configFile)
 {
@@ -894,7 +751,9 @@ void errorHandler(GWorld *world_h)
 	system("PAUSE");
 	exit(-1);
 }
-void doLoop(GModel *mHost){
+// Model is GModel, a class derived from it, or a static model, see GModelT
+template<class Model>
+void doLoop(Model *mHost){
 	cudaMalloc((void**)&worldHash, modelHostParams.MAX_AGENT_NO*sizeof(int));
 	cudaMalloc((void**)&pos, sizeof(FLOATn)*modelHostParams.MAX_AGENT_NO);
 
@@ -904,10 +763,7 @@ void doLoop(GModel *mHost){
 	float time;
 	cudaEventCreate(&start);
 	cudaEventCreate(&stop);
-	std::fstream fout;
-	char *outfname = new char[30];
-	sprintf(outfname, "doLoop count.txt");
-	fout.open(outfname, std::ios::out);
+	GOutputStage<Model> output("doLoop.log", mHost, OUTPUT_POLICY, OUTPUT_QUEUE_DEPTH);
 
 	for (; stepCountHost<STEPS; stepCountHost++){
 		//if ((i%(STEPS/100))==0) 
@@ -923,9 +779,15 @@ void doLoop(GModel *mHost){
 		cudaEventRecord(stop, 0);
 		cudaEventSynchronize(stop);
 		cudaEventElapsedTime(&time, start, stop);
-		fout<<time<<std::endl;
+
+		GStepRecord rec;
+		rec.step = stepCountHost;
+		rec.timeMs = time;
+		rec.numAgent = modelHostParams.AGENT_NO;
+		mHost->snapshot(rec);
+		output.push(rec);
 	}
-	fout.close();
+	output.close();
 	mHost->stop();
 	cudaFree(worldHash);
 	printf("finally total agent is %d\n", modelHostParams.AGENT_NO);
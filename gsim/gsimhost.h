@@ -0,0 +1,769 @@
+#ifndef GSIMHOST_H
+#define GSIMHOST_H
+#include "gsimlib_header.cuh"
+#include "gsimoutput.h"
+#include <atomic>
+#include <vector>
+#include <algorithm>
+#include <omp.h>
+#include <xmmintrin.h>
+#ifdef _WIN32
+#include <Windows.h>
+#else
+#include <sys/time.h>
+#endif
+
+/* host backend of gsim: the classes of gsimcore.cuh with the same names and interface, for
+nodes without a GPU. A model includes this header instead of gsimcore.cuh. Kernels become
+OpenMP loops over the pool, device atomics std::atomic, and the "device" copy made by
+util::hostAllocCopyToDevice is the host object itself, so host and device pointers agree */
+
+#define HOST_CHUNK 1024 // pool slots per work item of the parallel loops
+#define HOST_TILE_BYTES 2048 // neighbor data staged per iterator, stays in L1
+#define HOST_TILE_MAX 32 // at most as many neighbors per tile as a warp stages in shared memory
+#define HOST_RADIX_BITS 16 // hash bits per radix pass, a 2D grid of up to 256 x 256 cells takes one
+
+//class delaration
+class GAgent;
+class GWorld;
+class GScheduler;
+class GModel;
+class GRandom;
+template<class Agent, class AgentData> class AgentPool;
+
+/* the iterator state of gsimcore.cuh plus the tile that takes the place of shared memory.
+It lives on the stack of the agent that queries, so the tile is private to the thread */
+typedef struct iter_info_per_thread
+{
+	INTn cellCur;
+	INTn cellHead;
+	INTn cellTail;
+
+	int boarder;
+	int ptrInWorld;
+	int ptrInSmem;
+	int tileNum;	// neighbors in the tile
+
+	bool infected;
+
+	double2 tile[HOST_TILE_BYTES / sizeof(double2)];	// double2 for the 16 byte alignment of vector types
+} iterInfo;
+
+int stepCountHost = 0;
+int stepCount = 0; // the __constant__ of gsimcore.cuh, set by doLoop
+int *worldHash;		// hash of world->allAgents[i], sorted along with it
+int *hashScratch;	// scratch of genNeighbor
+GAgent **agentScratch;
+int *radixCount;	// digit counts of genNeighbor, bucket-major, one entry per chunk
+
+namespace util{
+	void genNeighbor(GWorld *world, GWorld *world_h, int numAgent);
+	template<class Type> void hostAllocCopyToDevice(Type *hostPtr, Type **devicePtr);
+	// CUDA atomicInc: returns the old value, the counter wraps to 0 once it reached limit
+	unsigned int atomicInc(std::atomic<unsigned int> &counter, unsigned int limit);
+	void atomicMin(std::atomic<unsigned int> &value, unsigned int v);
+	double hostTimeMs();
+};
+
+typedef struct GAgentData{
+	FLOATn loc;
+	GAgent *agentPtr;
+} GAgentData_t;
+
+class GAgent
+{
+public:
+	GAgentData_t *data;
+	GAgentData_t *dataCopy;
+
+	int ptrInPool;
+	uchar4 color;
+
+public:
+	__device__ void swapDataAndCopy(){
+		GAgentData_t *temp = this->data;
+		this->data = this->dataCopy;
+		this->dataCopy = temp;
+	}
+	__device__ int locHash() {
+		FLOATn myLoc = this->data->loc;
+		int xhash = util::cellOf(myLoc.x, modelDevParams.CLEN_X, modelDevParams.CNO_PER_DIM);
+		int yhash = util::cellOf(myLoc.y, modelDevParams.CLEN_Y, modelDevParams.CNO_PER_DIM);
+#ifdef GWORLD_3D
+		int zhash = util::cellOf(myLoc.z, modelDevParams.CLEN_Z, modelDevParams.CNO_PER_DIM_Z);
+		return util::cellZcode(xhash, yhash, zhash);
+#else
+		return util::zcode(xhash, yhash);
+#endif
+	}
+};
+
+class GWorld
+{
+public:
+	int numAgentWorld;
+	float width;
+	float height;
+#ifdef GWORLD_3D
+	float depth;
+#endif
+public:
+	GAgent **allAgents;
+	int *cellIdxStart;
+	int *cellIdxEnd;
+public:
+	GWorld(){
+		this->width = modelHostParams.WIDTH;
+		this->height = modelHostParams.HEIGHT;
+#ifdef GWORLD_3D
+		this->depth = modelHostParams.DEPTH;
+#endif
+		this->numAgentWorld = 0;
+		this->allAgents = new GAgent*[modelHostParams.MAX_AGENT_NO];
+		this->cellIdxStart = new int[modelHostParams.CELL_NO];
+		this->cellIdxEnd = new int[modelHostParams.CELL_NO];
+	}
+#ifdef GWORLD_3D
+	GWorld(float w, float h, float d){
+		this->width = w;
+		this->height = h;
+		this->depth = d;
+		this->numAgentWorld = 0;
+		this->allAgents = new GAgent*[modelHostParams.MAX_AGENT_NO];
+		this->cellIdxStart = new int[modelHostParams.CELL_NO];
+		this->cellIdxEnd = new int[modelHostParams.CELL_NO];
+	}
+#endif
+	GAgent* obtainAgent(int idx) const {
+		GAgent *ag = NULL;
+		if (idx < numAgentWorld && idx >= 0)
+			ag = this->allAgents[idx];
+		return ag;
+	}
+	//distance utility
+	float stx(float x, float width) const;
+	float sty(float y, float height) const;
+	float tdx(float ax, float bx) const;
+	float tdy(float ay, float by) const;
+#ifdef GWORLD_3D
+	float stz(float z, float depth) const;
+	float tdz(float az, float bz) const;
+#endif
+	//Neighbors related
+	void neighborQueryInit(const FLOATn &loc, float range, iterInfo &info) const;
+	void neighborQueryReset(iterInfo &info) const;
+	template<class dataUnion> dataUnion* nextAgentDataFromSharedMem(iterInfo &info) const;
+	GAgentData_t *nextAgentData(iterInfo &info) const;
+	template<class dataUnion> GAgent *nextAgent(iterInfo &info) const;
+private:
+	bool iterContinue(iterInfo &info) const;
+	template<class dataUnion> void setSMem(iterInfo &info) const;
+	void calcPtrAndBoarder(iterInfo &info) const;
+	bool nextCell(const iterInfo &info, INTn &cell) const;
+	void ghostRange(float loc, float range, float clen, int cno, int &head, int &tail) const;
+	int cellHash(const INTn &cell) const;
+	void prefetchCell(const INTn &cell) const;
+};
+
+class GScheduler
+{
+public:
+	GAgent **agentPtrArray;
+	GScheduler(){
+		this->agentPtrArray = new GAgent*[modelHostParams.MAX_AGENT_NO];
+	}
+};
+
+class GModel
+{
+public:
+	GModel *model;
+public:
+	__host__ virtual void start() = 0;
+	__host__ virtual void preStep() = 0;
+	__host__ virtual void step() = 0;
+	__host__ virtual void stop() = 0;
+	// loop thread, after step: what the output stage gets of this step
+	__host__ virtual void snapshot(GStepRecord &rec) {}
+	// output thread, the records in step order while the following steps run
+	__host__ virtual void consume(const GStepRecord &rec) {}
+};
+
+/* static model: Model derives from GModelT<Model> and has start, preStep, step and stop as
+plain members. doLoop<Model> and stepPoolAgent<Model> call them and Agent::step(Model*)
+directly, so the step of an agent is inlined into the loop of the pool. GModelAdapter gives
+such a model the virtual GModel interface for code that holds a GModel* */
+template<class Model> class GModelT
+{
+public:
+	Model *model;	// device copy, as GModel::model
+public:
+	__host__ void snapshot(GStepRecord &rec) {}
+	__host__ void consume(const GStepRecord &rec) {}
+};
+
+template<class Model> class GModelAdapter : public GModel
+{
+	Model *m;
+public:
+	__host__ GModelAdapter(Model *m) : m(m) {
+		this->model = NULL; // agents of a static model get m->model
+	}
+	__host__ void start() { m->start(); }
+	__host__ void preStep() { m->preStep(); }
+	__host__ void step() { m->step(); }
+	__host__ void stop() { m->stop(); }
+	__host__ void snapshot(GStepRecord &rec) { m->snapshot(rec); }
+	__host__ void consume(const GStepRecord &rec) { m->consume(rec); }
+};
+
+// same keys as the device GRandom, a run on the host draws the same numbers as on the GPU
+class GRandom {
+	unsigned int seed;
+public:
+	GRandom() {
+		seed = modelHostParams.RANDOM_SEED;
+	}
+	float uniform(int contextId, int stream){
+		return util::randomUniform(util::randomBits(seed, contextId, stepCount, stream).x);
+	}
+	float gaussian(int contextId, int stream){
+		uint4 bits = util::randomBits(seed, contextId, stepCount, stream);
+		return util::randomGaussian(bits.x, bits.y);
+	}
+};
+
+/* the pool of gsimcore.cuh on the host. agentSlot, add and remove may be called from the
+threads of stepPoolAgent like from a kernel, delMark and the counters are atomics for that */
+template<class Agent, class AgentData> class AgentPool
+{
+public:
+	size_t shareDataSize;
+	/* objects to be deleted will be marked as delete */
+	std::atomic<int> *delMark;
+	/* pointer array, elements are pointers points to elements in data array */
+	int *dataIdxArray;
+	/* check if elements are inserted or deleted from pool*/
+	std::atomic<bool> modified;
+	unsigned int numElem;
+	unsigned int numElemMax;
+	std::atomic<unsigned int> incCount;
+	std::atomic<unsigned int> decCount;
+	/* lowest slot removed since the last cleanup, the slots below it are all live */
+	std::atomic<unsigned int> dirtyBegin;
+	/* keeping the actual Agents */
+	Agent **agentPtrArray;
+	/* Agent array*/
+	Agent *agentArray;
+	/* ptrArray to agent data*/
+	AgentData *dataArray;
+	/* ptrArray to agent data copy*/
+	AgentData *dataCopyArray;
+	/* scratch of cleanup */
+	Agent **agentPtrScratch;
+	int *dataIdxScratch;
+	int *chunkLive;
+
+	//Pool implementation
+	int agentSlot()
+	{
+		return util::atomicInc(incCount, numElemMax-numElem) + numElem;
+	}
+	int add(Agent *o, int agentSlot)
+	{
+		this->modified = true;
+		this->delMark[agentSlot] = false;
+		this->agentPtrArray[agentSlot] = o;
+		return this->dataIdxArray[agentSlot];
+	}
+	int dataSlot(int agentSlot)
+	{
+		return this->dataIdxArray[agentSlot];
+	}
+	Agent* agentInSlot(int dataSlot) {
+		return &this->agentArray[dataSlot];
+	}
+	AgentData* dataInSlot(int dataSlot){
+		return &this->dataArray[dataSlot];
+	}
+	AgentData* dataCopyInSlot(int dataSlot){
+		return &this->dataCopyArray[dataSlot];
+	}
+	void remove(int agentSlot)
+	{
+		int alive = false;
+		if (this->delMark[agentSlot].compare_exchange_strong(alive, true)) {
+			util::atomicInc(decCount, numElem);
+			util::atomicMin(dirtyBegin, agentSlot);
+		}
+
+		this->modified = true;
+	}
+	void alloc(int nElem, int nElemMax){
+		printf("AgentPool::alloc: Agent size: %d, AgentData size: %d\n", sizeof(Agent), sizeof(AgentData));
+		this->numElem = nElem;
+		this->numElemMax = nElemMax;
+		this->incCount = 0;
+		this->decCount = 0;
+		this->dirtyBegin = 0; // the first nElem slots are filled by add directly, none is known live
+		this->modified = false;
+		this->delMark = new std::atomic<int>[nElemMax];
+		this->agentArray = new Agent[nElemMax];
+		this->agentPtrArray = new Agent*[nElemMax];
+		this->dataArray = new AgentData[nElemMax];
+		this->dataCopyArray = new AgentData[nElemMax];
+		this->dataIdxArray = new int[nElemMax];
+		this->agentPtrScratch = new Agent*[nElemMax];
+		this->dataIdxScratch = new int[nElemMax];
+		this->chunkLive = new int[nElemMax / HOST_CHUNK + 2];
+		memset(this->agentPtrArray, 0x00, nElemMax * sizeof(Agent*));
+		for (int i = 0; i < nElemMax; i++) {
+			this->dataIdxArray[i] = i;
+			this->delMark[i] = true;
+		}
+	}
+	/* stable compaction as thrust::stable_partition in gsimcore.cuh, over the range a step
+	touched as there: slots below min(dirtyBegin, numElem) are live, slots from numElem +
+	incCount on were never handed out. Every chunk of the range counts its live slots, the
+	prefix of the counts places them, the freed slots (and their data indices) follow all live
+	ones in their old order. A pool without change costs nothing */
+	bool cleanup(AgentPool<Agent, AgentData> *pDev)
+	{
+		int begin = min(this->dirtyBegin.load(), this->numElem);
+		int end = min(this->numElem + this->incCount.load(), this->numElemMax);
+		this->incCount = 0;
+		this->decCount = 0;
+		this->dirtyBegin = this->numElemMax;
+		bool poolModifiedLocal = this->modified;
+		this->modified = false;
+		if (begin >= end)
+			return poolModifiedLocal && this->numElem > 0;
+
+		int numChunk = (end - begin + HOST_CHUNK - 1) / HOST_CHUNK;
+#pragma omp parallel for
+		for (int c = 0; c < numChunk; c++) {
+			int last = min(begin + (c + 1) * HOST_CHUNK, end);
+			int live = 0;
+			for (int i = begin + c * HOST_CHUNK; i < last; i++)
+				live += this->delMark[i] == false;
+			chunkLive[c + 1] = live;
+		}
+		chunkLive[0] = 0;
+		for (int c = 0; c < numChunk; c++)
+			chunkLive[c + 1] += chunkLive[c];
+		this->numElem = begin + chunkLive[numChunk];
+
+#pragma omp parallel for
+		for (int c = 0; c < numChunk; c++) {
+			int last = min(begin + (c + 1) * HOST_CHUNK, end);
+			int live = begin + chunkLive[c];
+			int freed = numElem + c * HOST_CHUNK - chunkLive[c];
+			for (int i = begin + c * HOST_CHUNK; i < last; i++) {
+				int dst = this->delMark[i] == false ? live++ : freed++;
+				agentPtrScratch[dst] = agentPtrArray[i];
+				dataIdxScratch[dst] = dataIdxArray[i];
+			}
+		}
+		// copied back, models keep pointers to agentPtrArray
+#pragma omp parallel for
+		for (int i = begin; i < end; i++) {
+			agentPtrArray[i] = agentPtrScratch[i];
+			dataIdxArray[i] = dataIdxScratch[i];
+			this->delMark[i] = i >= (int)numElem;
+		}
+
+		return poolModifiedLocal && this->numElem > 0;
+	}
+	void registerPool(GWorld *worldHost, GScheduler *schedulerHost, AgentPool<Agent, AgentData> *pDev)
+	{
+		// clean up the slots
+		cleanup(pDev);
+
+		// copy the agents to world
+		if (numElem > 0) {
+			Agent **worldPtrArray = (Agent**)worldHost->allAgents;
+			memcpy(worldPtrArray + worldHost->numAgentWorld, agentPtrArray, numElem * sizeof(Agent*));
+		}
+		//worldHost->numAgentWorld += numElem;
+	}
+	void swapPool() {
+#pragma omp parallel for
+		for (int i = 0; i < (int)numElem; i++)
+			agentPtrArray[i]->swapDataAndCopy();
+	}
+	AgentPool(int nElem, int nElemMax, size_t sizeOfSharedData){
+		if (nElemMax < nElem)
+			nElemMax = nElem;
+		this->shareDataSize = sizeOfSharedData + sizeof(int);
+		this->shareDataSize *= BLOCK_SIZE;
+		this->alloc(nElem, nElemMax);
+	}
+	/* runs step of every agent, the stream is ignored on the host. Model is GModel or, for a
+	static model, the model class itself */
+	template<class Model>
+	int stepPoolAgent(Model *model, cudaStream_t poolStream)
+	{
+		if (numElem <= 0)
+			return 0;
+		int n = numElem;
+#pragma omp parallel for schedule(dynamic, HOST_CHUNK)
+		for (int i = 0; i < n; i++) {
+			Agent *ag = agentPtrArray[i];
+			ag->ptrInPool = i;
+			ag->step(model);
+		}
+		return n;
+	}
+};
+
+//GWorld
+// positions and distances under GWORLD_BOUNDARY, see gsimboundary.h
+float GWorld::stx(float x, float width) const{
+	return util::boundPos(x, width);
+}
+float GWorld::sty(float y, float height) const {
+	return util::boundPos(y, height);
+}
+float GWorld::tdx(float ax, float bx) const {
+	return util::boundDelta(ax - bx, this->width);
+}
+float GWorld::tdy(float ay, float by) const {
+	return util::boundDelta(ay - by, this->height);
+}
+#ifdef GWORLD_3D
+float GWorld::stz(float z, float depth) const {
+	return util::boundPos(z, depth);
+}
+float GWorld::tdz(float az, float bz) const {
+	return util::boundDelta(az - bz, this->depth);
+}
+#endif
+/* the cell range of the query. On the device a warp walks the union of the ranges of its
+threads, on the host every agent walks its own. In a 3D world a range up to the cell length
+is the 27 cell stencil, walked x first, then y, then floor by floor */
+void GWorld::neighborQueryInit(const FLOATn &agLoc, float range, iterInfo &info) const {
+	info.ptrInWorld = -1;
+	info.boarder = -1;
+	info.ptrInSmem = 0;
+	info.tileNum = 0;
+
+#if GWORLD_BOUNDARY == BOUNDARY_PERIODIC
+	ghostRange(agLoc.x, range, modelDevParams.CLEN_X, modelDevParams.CNO_PER_DIM, info.cellHead.x, info.cellTail.x);
+	ghostRange(agLoc.y, range, modelDevParams.CLEN_Y, modelDevParams.CNO_PER_DIM, info.cellHead.y, info.cellTail.y);
+#ifdef GWORLD_3D
+	ghostRange(agLoc.z, range, modelDevParams.CLEN_Z, modelDevParams.CNO_PER_DIM_Z, info.cellHead.z, info.cellTail.z);
+#endif
+#else
+	// clamped as in locHash, so an agent outside the world still finds the border cells
+	info.cellHead.x = util::cellOf(agLoc.x - range, modelDevParams.CLEN_X, modelDevParams.CNO_PER_DIM);
+	info.cellTail.x = util::cellOf(agLoc.x + range, modelDevParams.CLEN_X, modelDevParams.CNO_PER_DIM);
+	info.cellHead.y = util::cellOf(agLoc.y - range, modelDevParams.CLEN_Y, modelDevParams.CNO_PER_DIM);
+	info.cellTail.y = util::cellOf(agLoc.y + range, modelDevParams.CLEN_Y, modelDevParams.CNO_PER_DIM);
+#ifdef GWORLD_3D
+	info.cellHead.z = util::cellOf(agLoc.z - range, modelDevParams.CLEN_Z, modelDevParams.CNO_PER_DIM_Z);
+	info.cellTail.z = util::cellOf(agLoc.z + range, modelDevParams.CLEN_Z, modelDevParams.CNO_PER_DIM_Z);
+#endif
+#endif
+	info.cellCur = info.cellHead;
+
+	this->calcPtrAndBoarder(info);
+}
+/* periodic worlds: the range may leave the grid into ghost cells. A range wider than the world
+along an axis walks the grid once instead, an agent is then seen once and not at its nearest
+image, so ranges up to half the world get minimum image distances */
+void GWorld::ghostRange(float loc, float range, float clen, int cno, int &head, int &tail) const {
+	head = (int)floorf((loc - range) / clen);
+	tail = (int)floorf((loc + range) / clen);
+	if (tail - head >= cno) {
+		head = 0;
+		tail = cno - 1;
+	}
+}
+void GWorld::neighborQueryReset(iterInfo &info) const{
+	info.ptrInWorld = -1;
+	info.boarder = -1;
+	info.ptrInSmem = 0;
+	info.tileNum = 0;
+	info.cellCur = info.cellHead;
+	this->calcPtrAndBoarder(info);
+}
+int GWorld::cellHash(const INTn &cell) const {
+	INTn c = cell;
+#if GWORLD_BOUNDARY == BOUNDARY_PERIODIC
+	// a ghost cell stands for the cell on the other side of the world
+	c.x &= modelDevParams.CNO_PER_DIM - 1;
+	c.y &= modelDevParams.CNO_PER_DIM - 1;
+#ifdef GWORLD_3D
+	c.z &= modelDevParams.CNO_PER_DIM_Z - 1;
+#endif
+#endif
+#ifdef GWORLD_3D
+	return util::cellZcode(c.x, c.y, c.z);
+#else
+	int worldHash = util::zcode(c.x, c.y);
+	if (worldHash < modelDevParams.CELL_NO && worldHash >= 0)
+		return worldHash;
+	return -1;
+#endif
+}
+void GWorld::calcPtrAndBoarder(iterInfo &info) const {
+	int worldHash = cellHash(info.cellCur);
+	if (worldHash >= 0) {
+		info.ptrInWorld = this->cellIdxStart[worldHash];
+		info.boarder = this->cellIdxEnd[worldHash];
+	}
+}
+// asks for the first agents of a cell while the current one is still being read
+void GWorld::prefetchCell(const INTn &cell) const {
+	int worldHash = cellHash(cell);
+	if (worldHash < 0)
+		return;
+	int start = this->cellIdxStart[worldHash];
+	int end = this->cellIdxEnd[worldHash];
+	if (start < 0 || start >= end)
+		return;
+	_mm_prefetch((const char*)&this->allAgents[start], _MM_HINT_T0);
+	for (int i = start; i < end && i < start + 4; i++)
+		_mm_prefetch((const char*)this->allAgents[i]->data, _MM_HINT_T0);
+}
+template<class dataUnion> dataUnion *GWorld::nextAgentDataFromSharedMem(iterInfo &info) const {
+	if (!iterContinue(info))
+		return NULL;
+
+	setSMem<dataUnion>(info);
+
+	dataUnion *elem = &((dataUnion*)info.tile)[info.ptrInSmem];
+	info.ptrInSmem++;
+	info.ptrInWorld++;
+
+	return elem;
+}
+GAgentData_t *GWorld::nextAgentData(iterInfo &info) const
+{
+	if (!iterContinue(info))
+		return NULL;
+
+	GAgent *ag = this->obtainAgent(info.ptrInWorld);
+	info.ptrInWorld++;
+	return ag->data;
+}
+template<class dataUnion> GAgent *GWorld::nextAgent(iterInfo &info) const
+{
+	if (!iterContinue(info))
+		return NULL;
+
+	GAgent *ag = this->obtainAgent(info.ptrInWorld);
+	info.ptrInWorld++;
+	return ag;
+}
+// the cell after cell in the walk of the query, false past the last one
+bool GWorld::nextCell(const iterInfo &info, INTn &cell) const
+{
+	cell.x++;
+	if (cell.x <= info.cellTail.x)
+		return true;
+	cell.x = info.cellHead.x;
+	cell.y++;
+#ifdef GWORLD_3D
+	if (cell.y <= info.cellTail.y)
+		return true;
+	cell.y = info.cellHead.y;
+	cell.z++;
+	return cell.z <= info.cellTail.z;
+#else
+	return cell.y <= info.cellTail.y;
+#endif
+}
+bool GWorld::iterContinue(iterInfo &info) const
+{
+	while (info.ptrInWorld>=info.boarder) {
+		info.ptrInSmem = 0;
+		info.tileNum = 0;
+		if (!nextCell(info, info.cellCur))
+			return false;
+		this->calcPtrAndBoarder(info);
+	}
+	return true;
+}
+/* refills the tile once it is used up: the next neighbors of the cell are copied in by
+putDataInSmem. With the last tile of a cell the next cell of the walk is prefetched */
+template<class dataUnion> void GWorld::setSMem(iterInfo &info) const
+{
+	const int tileCap = min(HOST_TILE_BYTES / (int)sizeof(dataUnion), HOST_TILE_MAX);
+	if (info.ptrInSmem < info.tileNum)
+		return;
+
+	dataUnion *tile = (dataUnion*)info.tile;
+	int num = min(tileCap, info.boarder - info.ptrInWorld);
+	for (int i = 0; i < num; i++)
+		tile[i].putDataInSmem(this->obtainAgent(info.ptrInWorld + i));
+	info.ptrInSmem = 0;
+	info.tileNum = num;
+
+	INTn next = info.cellCur;
+	if (info.ptrInWorld + num >= info.boarder && nextCell(info, next))
+		prefetchCell(next);
+}
+
+/* spatial hashing on the host: a stable LSD radix sort of the agents by the util::zcode cell hash of locHash
+in digits of HOST_RADIX_BITS, only over the bits the grid uses. Every chunk of the agent list
+counts its digits, the prefix over (bucket, chunk) gives where a chunk scatters each bucket.
+The first count is taken while hashing, so a single digit grid reads the agents once and
+writes them once. With a single digit the bucket is the cell, and the same prefix scan yields
+cellIdxStart / cellIdxEnd of every cell, empty cells get -1 as after the device memset */
+void util::genNeighbor(GWorld *world, GWorld *world_h, int numAgent)
+{
+	if (world == NULL || numAgent <= 0)
+		return;
+	int hashBits = 0;
+	while ((1 << hashBits) < modelHostParams.CELL_NO)
+		hashBits++;
+	int numDigit = max((hashBits + HOST_RADIX_BITS - 1) / HOST_RADIX_BITS, 1);
+	int numChunk = min(omp_get_max_threads(), (numAgent + HOST_CHUNK - 1) / HOST_CHUNK);
+	int chunkSize = (numAgent + numChunk - 1) / numChunk;
+
+	for (int d = 0; d < numDigit; d++) {
+		int shift = d * HOST_RADIX_BITS;
+		int numBucket = 1 << min(HOST_RADIX_BITS, max(hashBits - shift, 0));
+		int mask = numBucket - 1;
+		GAgent **agents = world_h->allAgents;
+
+#pragma omp parallel for
+		for (int c = 0; c < numChunk; c++) {
+			int *count = radixCount + c;
+			for (int b = 0; b < numBucket; b++)
+				count[b * numChunk] = 0;
+			int end = min((c + 1) * chunkSize, numAgent);
+			for (int i = c * chunkSize; i < end; i++) {
+				if (d == 0)
+					worldHash[i] = agents[i]->locHash();
+				count[((worldHash[i] >> shift) & mask) * numChunk]++;
+			}
+		}
+
+		int offset = 0;
+		for (int b = 0; b < numBucket; b++) {
+			int bucketStart = offset;
+			for (int c = 0; c < numChunk; c++) {
+				int n = radixCount[b * numChunk + c];
+				radixCount[b * numChunk + c] = offset;
+				offset += n;
+			}
+			if (numDigit == 1 && b < modelHostParams.CELL_NO) {
+				world_h->cellIdxStart[b] = offset > bucketStart ? bucketStart : -1;
+				world_h->cellIdxEnd[b] = offset > bucketStart ? offset : -1;
+			}
+		}
+
+#pragma omp parallel for
+		for (int c = 0; c < numChunk; c++) {
+			int *dst = radixCount + c;
+			int end = min((c + 1) * chunkSize, numAgent);
+			for (int i = c * chunkSize; i < end; i++) {
+				int hash = worldHash[i];
+				int pos = dst[((hash >> shift) & mask) * numChunk]++;
+				hashScratch[pos] = hash;
+				agentScratch[pos] = agents[i];
+			}
+		}
+		std::swap(worldHash, hashScratch);
+		std::swap(world_h->allAgents, agentScratch);
+	}
+
+	// several digits: the cells are bounded as in generateCellIdx
+	if (numDigit > 1) {
+#pragma omp parallel for
+		for (int i = 0; i < modelHostParams.CELL_NO; i++) {
+			world_h->cellIdxStart[i] = -1;
+			world_h->cellIdxEnd[i] = -1;
+		}
+#pragma omp parallel for
+		for (int i = 0; i < numAgent; i++) {
+			if (i == 0 || worldHash[i] != worldHash[i - 1])
+				world_h->cellIdxStart[worldHash[i]] = i;
+			if (i == numAgent - 1 || worldHash[i] != worldHash[i + 1])
+				world_h->cellIdxEnd[worldHash[i]] = i + 1;
+		}
+	}
+}
+template<class Type> void util::hostAllocCopyToDevice(Type *hostPtr, Type **devPtr)
+{
+	*devPtr = hostPtr;
+}
+unsigned int util::atomicInc(std::atomic<unsigned int> &counter, unsigned int limit)
+{
+	unsigned int old = counter.load();
+	while (!counter.compare_exchange_weak(old, old >= limit ? 0 : old + 1));
+	return old;
+}
+void util::atomicMin(std::atomic<unsigned int> &value, unsigned int v)
+{
+	unsigned int old = value.load();
+	while (v < old && !value.compare_exchange_weak(old, v));
+}
+double util::hostTimeMs()
+{
+#ifdef _WIN32
+	LARGE_INTEGER freq, now;
+	QueryPerformanceFrequency(&freq);
+	QueryPerformanceCounter(&now);
+	return (double)now.QuadPart * 1000.0 / freq.QuadPart;
+#else
+	timeval now;
+	gettimeofday(&now, NULL);
+	return now.tv_sec * 1000.0 + now.tv_usec / 1000.0;
+#endif
+}
+
+//execution logic
+size_t sizeOfSmem = 0;
+template<class SharedMemoryData> void init(char *configFile)
+{
+	readConfig(configFile);
+	printf("steps: %d\n", STEPS);
+	printf("host backend, threads: %d\n", omp_get_max_threads());
+
+	sizeOfSmem = sizeof(SharedMemoryData) + sizeof(int);
+	sizeOfSmem *= BLOCK_SIZE;
+
+	colorConfigs.blue	=	make_uchar4(0, 0, 128, 0);
+	colorConfigs.green	=	make_uchar4(0, 128, 0, 128);
+	colorConfigs.red	=	make_uchar4(128, 0, 0, 0);
+	colorConfigs.yellow	=	make_uchar4(128, 128, 0, 0);
+	colorConfigs.white	=	make_uchar4(255, 255, 255, 0);
+	colorConfigs.black	=	make_uchar4(0, 0, 0, 0);
+}
+// Model is GModel, a class derived from it, or a static model, see GModelT
+template<class Model>
+void doLoop(Model *mHost){
+	int maxAgent = modelHostParams.MAX_AGENT_NO;
+	worldHash = new int[maxAgent];
+	hashScratch = new int[maxAgent];
+	agentScratch = new GAgent*[maxAgent];
+	radixCount = new int[(1 << HOST_RADIX_BITS) * omp_get_max_threads()];
+
+	mHost->start();
+
+	GOutputStage<Model> output("doLoop.log", mHost, OUTPUT_POLICY, OUTPUT_QUEUE_DEPTH);
+
+	for (; stepCountHost<STEPS; stepCountHost++){
+		printf("STEP:%d ", stepCountHost);
+		stepCount = stepCountHost;
+		double start = util::hostTimeMs();
+
+		mHost->preStep();
+
+		mHost->step();
+
+		GStepRecord rec;
+		rec.step = stepCountHost;
+		rec.timeMs = (float)(util::hostTimeMs() - start);
+		rec.numAgent = modelHostParams.AGENT_NO;
+		mHost->snapshot(rec);
+		output.push(rec);
+	}
+	output.close();
+	mHost->stop();
+	printf("finally total agent is %d\n", modelHostParams.AGENT_NO);
+}
+#endif
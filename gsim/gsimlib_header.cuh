@@ -9,18 +9,30 @@
 #include "cuda_runtime.h"
 #include "device_launch_parameters.h"
 #include "float.h"
+#include <cstring>
+#include <cstdlib>
+#ifdef __CUDACC__
 #include <curand_kernel.h>
 #include <thrust/sort.h>
+#include <thrust/partition.h>
 #include <thrust/device_vector.h>
 #include <thrust/device_ptr.h>
 #include <thrust/functional.h>
 #include <thrust/transform.h>
 #include <thrust/host_vector.h>
+#endif
 #include "inc/helper_math.h"
+#include "gsimrandom.h"
+#include "gsimboundary.h"
 
+//#define GWORLD_3D
+#ifdef GWORLD_3D
+#define FLOATn float3
+#define INTn int3
+#else
 #define FLOATn float2
 #define INTn int2
-//#define GWORLD_3D
+#endif
 
 struct agentColor
 {
@@ -42,11 +54,18 @@ struct modelConstants
 	int CNO_PER_DIM;	//(int)pow((float)2, DISCRETI)
 	float CLEN_X;		//WIDTH/(float)CNO_PER_DIM;
 	float CLEN_Y;		//HEIGHT/(float)CNO_PER_DIM;
-	float CLEN_Z;		//DEPTH/(float)CNO_PER_DIM;
+	float CLEN_Z;		//DEPTH/(float)CNO_PER_DIM_Z;
+	int CNO_PER_DIM_Z;	//(int)pow((float)2, DISCRETI_Z), the floors of a 3D world
+	int DISCRETI_Z;
 	int RANDOM_SEED;
 	int MAX_AGENT_NO;
 };
 
+#ifndef __CUDACC__
+// host backend (gsimhost.h): the constants are plain host variables
+#undef __constant__
+#define __constant__
+#endif
 __constant__ agentColor colorConfigs;
 __constant__ modelConstants modelDevParams;
 modelConstants modelHostParams;
@@ -56,6 +75,8 @@ size_t STACK_SIZE;	//read from config
 int STEPS;			//read from config
 bool VISUALIZE;		//read from config
 int BLOCK_SIZE;		//read from config
+int OUTPUT_POLICY = 0;		//read from config, see gsimoutput.h
+int OUTPUT_QUEUE_DEPTH = 4;	//read from config
 #define GRID_SIZE(n) (n%BLOCK_SIZE==0 ? n/BLOCK_SIZE : n/BLOCK_SIZE + 1)
 
 namespace SCHEDULE_CONSTANT{
@@ -65,6 +86,198 @@ namespace SCHEDULE_CONSTANT{
 	static const float EPSILON = 1.0;
 };
 
+// Morton code of a cell, shared by the device and the host backend
+namespace util{
+	__host__ __device__ inline int zcode(int x, int y)
+	{
+		x &= 0x0000ffff;					// x = ---- ---- ---- ---- fedc ba98 7654 3210
+		y &= 0x0000ffff;					// x = ---- ---- ---- ---- fedc ba98 7654 3210
+		x = (x ^ (x << 8)) & 0x00ff00ff; // x = ---- ---- fedc ba98 ---- ---- 7654 3210
+		y = (y ^ (y << 8)) & 0x00ff00ff; // x = ---- ---- fedc ba98 ---- ---- 7654 3210
+		y = (y ^ (y << 4)) & 0x0f0f0f0f; // x = ---- fedc ---- ba98 ---- 7654 ---- 3210
+		x = (x ^ (x << 4)) & 0x0f0f0f0f; // x = ---- fedc ---- ba98 ---- 7654 ---- 3210
+		y = (y ^ (y << 2)) & 0x33333333; // x = --fe --dc --ba --98 --76 --54 --32 --10
+		x = (x ^ (x << 2)) & 0x33333333; // x = --fe --dc --ba --98 --76 --54 --32 --10
+		y = (y ^ (y << 1)) & 0x55555555; // x = -f-e -d-c -b-a -9-8 -7-6 -5-4 -3-2 -1-0
+		x = (x ^ (x << 1)) & 0x55555555; // x = -f-e -d-c -b-a -9-8 -7-6 -5-4 -3-2 -1-0
+		return x | (y << 1);
+	}
+	__host__ __device__ inline int zcode(int x, int y, int z)
+	{
+		x &= 0x000003ff;                  // x = ---- ---- ---- ---- ---- --98 7654 3210
+		x = (x ^ (x << 16)) & 0xff0000ff; // x = ---- --98 ---- ---- ---- ---- 7654 3210
+		x = (x ^ (x <<  8)) & 0x0300f00f; // x = ---- --98 ---- ---- 7654 ---- ---- 3210
+		x = (x ^ (x <<  4)) & 0x030c30c3; // x = ---- --98 ---- 76-- --54 ---- 32-- --10
+		x = (x ^ (x <<  2)) & 0x09249249; // x = ---- 9--8 --7- -6-- 5--4 --3- -2-- 1--0
+
+		y &= 0x000003ff;                  // y = ---- ---- ---- ---- ---- --98 7654 3210
+		y = (y ^ (y << 16)) & 0xff0000ff; // y = ---- --98 ---- ---- ---- ---- 7654 3210
+		y = (y ^ (y <<  8)) & 0x0300f00f; // y = ---- --98 ---- ---- 7654 ---- ---- 3210
+		y = (y ^ (y <<  4)) & 0x030c30c3; // y = ---- --98 ---- 76-- --54 ---- 32-- --10
+		y = (y ^ (y <<  2)) & 0x09249249; // y = ---- 9--8 --7- -6-- 5--4 --3- -2-- 1--0
+
+		z &= 0x000003ff;                  // z = ---- ---- ---- ---- ---- --98 7654 3210
+		z = (z ^ (z << 16)) & 0xff0000ff; // z = ---- --98 ---- ---- ---- ---- 7654 3210
+		z = (z ^ (z <<  8)) & 0x0300f00f; // z = ---- --98 ---- ---- 7654 ---- ---- 3210
+		z = (z ^ (z <<  4)) & 0x030c30c3; // z = ---- --98 ---- 76-- --54 ---- 32-- --10
+		z = (z ^ (z <<  2)) & 0x09249249; // z = ---- 9--8 --7- -6-- 5--4 --3- -2-- 1--0
+		return (z << 2) | (y << 1) | x;
+	}
+	// 21 bits per axis, for grids past the 1024 cells per axis of zcode(x, y, z)
+	__host__ __device__ inline unsigned long long spread3(unsigned long long v)
+	{
+		v &= 0x1fffff;
+		v = (v | (v << 32)) & 0x1f00000000ffffull;
+		v = (v | (v << 16)) & 0x1f0000ff0000ffull;
+		v = (v | (v <<  8)) & 0x100f00f00f00f00full;
+		v = (v | (v <<  4)) & 0x10c30c30c30c30c3ull;
+		v = (v | (v <<  2)) & 0x1249249249249249ull;
+		return v;
+	}
+	__host__ __device__ inline unsigned long long zcode64(int x, int y, int z)
+	{
+		return (spread3(z) << 2) | (spread3(y) << 1) | spread3(x);
+	}
+	/* cell of a 3D world: the low DISCRETI_Z bits of the three axes interleave as in a cube,
+	the rest of x and y goes above them as in zcode(x, y). The code stays dense in [0, CELL_NO)
+	when the world has fewer floors than cells per row, so the cell bounds of a few floors are
+	a few MB and not CNO_PER_DIM^3 ints. -1 outside the grid, locHash clamps to the grid first */
+	__device__ inline int cellZcode(int x, int y, int z)
+	{
+		int bits = modelDevParams.DISCRETI_Z;
+		int low = (1 << bits) - 1;
+		unsigned long long code = zcode64(x & low, y & low, z);
+		code |= (unsigned long long)(unsigned int)zcode(x >> bits, y >> bits) << (3 * bits);
+		if (x < 0 || y < 0 || z < 0 || z > low || code >= (unsigned long long)modelDevParams.CELL_NO)
+			return -1;
+		return (int)code;
+	}
+	/* cell of a coordinate along one axis for locHash, a position outside the world goes to the
+	border cell so every agent hashes into [0, CELL_NO) */
+	__host__ __device__ inline int cellOf(float p, float clen, int cno)
+	{
+		int c = (int)(p / clen);
+		return c < 0 ? 0 : (c < cno ? c : cno - 1);
+	}
+};
+
+void readConfig(char *config_file){
+	std::ifstream fin;
+	fin.open(config_file);
+	std::string rec;
+	char *cstr, *p;
+	cstr = (char *)malloc(100 * sizeof(char));
+
+
+	int discr = 0;
+	int discrZ = -1;
+
+	while (!fin.eof()) {
+		std::getline(fin, rec);
+		std::strcpy(cstr, rec.c_str());
+		if(strcmp(cstr,"")==0)
+			break;
+		p=strtok(cstr, "=");
+		if(strcmp(p, "AGENT_NO")==0){
+			p=strtok(NULL, "=");
+			modelHostParams.AGENT_NO = atoi(p);
+		}
+		if(strcmp(p, "MAX_AGENT_NO")==0){
+			p=strtok(NULL, "=");
+			modelHostParams.MAX_AGENT_NO = atoi(p);
+		}
+		if(strcmp(p, "WIDTH")==0){
+			p=strtok(NULL, "=");
+			modelHostParams.WIDTH = atoi(p);
+		}
+		if(strcmp(p, "HEIGHT")==0){
+			p=strtok(NULL, "=");
+			modelHostParams.HEIGHT = atoi(p);
+		}
+		if(strcmp(p, "DEPTH")==0){
+			p=strtok(NULL, "=");
+			modelHostParams.DEPTH = atoi(p);
+		}
+		if(strcmp(p, "DISCRETI")==0){
+			p=strtok(NULL, "=");
+			discr = atoi(p);
+		}
+		if(strcmp(p, "DISCRETI_Z")==0){
+			p=strtok(NULL, "=");
+			discrZ = atoi(p);
+		}
+		if(strcmp(p, "STEPS")==0){
+			p=strtok(NULL, "=");
+			STEPS = atoi(p);
+		}
+		if(strcmp(p, "VISUALIZE")==0){
+			p=strtok(NULL, "=");
+			VISUALIZE = atoi(p);
+		}
+		if(strcmp(p, "BLOCK_SIZE")==0){
+			p=strtok(NULL, "=");
+			BLOCK_SIZE = atoi(p);
+		}
+		if(strcmp(p, "OUTPUT_POLICY")==0){
+			p=strtok(NULL, "=");
+			OUTPUT_POLICY = atoi(p);
+		}
+		if(strcmp(p, "OUTPUT_QUEUE_DEPTH")==0){
+			p=strtok(NULL, "=");
+			OUTPUT_QUEUE_DEPTH = atoi(p);
+		}
+		if(strcmp(p, "HEAP_SIZE")==0){
+			p=strtok(NULL, "=");
+			HEAP_SIZE = atoi(p);
+		}
+		if(strcmp(p, "STACK_SIZE")==0){
+			p=strtok(NULL, "=");
+			STACK_SIZE = atoi(p);
+		}
+		if(strcmp(p, "RANDOM_SEED")==0){
+			p=strtok(NULL, "=");
+			modelHostParams.RANDOM_SEED = atoi(p);
+		}
+	}
+	free(cstr);
+	fin.close();
+
+	modelHostParams.CNO_PER_DIM = (int)pow((float)2, discr);
+	modelHostParams.CELL_NO = modelHostParams.CNO_PER_DIM * modelHostParams.CNO_PER_DIM;
+	modelHostParams.CLEN_X = modelHostParams.WIDTH/modelHostParams.CNO_PER_DIM;
+	modelHostParams.CLEN_Y = modelHostParams.HEIGHT/modelHostParams.CNO_PER_DIM;
+
+	modelHostParams.DISCRETI_Z = 0;
+	modelHostParams.CNO_PER_DIM_Z = 1;
+	modelHostParams.CLEN_Z = modelHostParams.DEPTH;
+
+#ifdef GWORLD_3D
+	// a cube unless DISCRETI_Z gives the floors, never more floors than cells per row
+	modelHostParams.DISCRETI_Z = discrZ >= 0 && discrZ < discr ? discrZ : discr;
+	modelHostParams.CNO_PER_DIM_Z = 1 << modelHostParams.DISCRETI_Z;
+	modelHostParams.CELL_NO *= modelHostParams.CNO_PER_DIM_Z;
+	modelHostParams.CLEN_Z = modelHostParams.DEPTH/modelHostParams.CNO_PER_DIM_Z;
+#endif
+
+	printf("model params:\n");
+	printf("\tmodelHostParams.AGENT_NO:%d\n", modelHostParams.AGENT_NO);
+	printf("\tmodelHostParams.CELL_NO:%d\n", modelHostParams.CELL_NO);
+	printf("\tmodelHostParams.CLEN_X:%f\n", modelHostParams.CLEN_X);
+	printf("\tmodelHostParams.CLEN_Y:%f\n", modelHostParams.CLEN_Y);
+	printf("\tmodelHostParams.CLEN_Z:%f\n", modelHostParams.CLEN_Z);
+	printf("\tmodelHostParams.CNO_PER_DIM:%d\n", modelHostParams.CNO_PER_DIM);
+	printf("\tmodelHostParams.CNO_PER_DIM_Z:%d\n", modelHostParams.CNO_PER_DIM_Z);
+	printf("\tmodelHostParams.WIDTH:%f\n", modelHostParams.WIDTH);
+	printf("\tmodelHostParams.DEPTH:%f\n", modelHostParams.DEPTH);
+	printf("\tmodelHostParams.HEIGHT:%f\n", modelHostParams.HEIGHT);
+	printf("\tmodelHostParams.MAX_AGENT_NO:%d\n", modelHostParams.MAX_AGENT_NO);
+
+#ifdef __CUDACC__
+	cudaMemcpyToSymbol(modelDevParams, &modelHostParams, sizeof(modelConstants));
+#else
+	modelDevParams = modelHostParams;
+#endif
+}
 #define checkCudaErrors(err)	__checkCudaErrors(err, __FILE__, __LINE__)
 inline void __checkCudaErrors( cudaError err, const char *file, const int line )
 {
@@ -0,0 +1,133 @@
+#ifndef GSIMOUTPUT_H
+#define GSIMOUTPUT_H
+#include <stdio.h>
+#include <vector>
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+
+/* the output stage of doLoop: the record of step N goes through a bounded queue to a thread
+that appends it to the binary log and hands it to the model's consume, while the loop goes on
+with step N+1. When the queue is full, OUTPUT_POLICY (config) decides what happens */
+#define OUTPUT_BLOCK 0			// the loop waits for a free entry, nothing is lost
+#define OUTPUT_DROP_NEWEST 1	// the record of the current step is dropped
+#define OUTPUT_DROP_OLDEST 2	// the oldest queued record makes room
+#define OUTPUT_LOG_MAGIC 0x474c5347	// "GSLG"
+#define OUTPUT_LOG_VERSION 1
+#define OUTPUT_LOG_BUFFER (1 << 20)
+
+/* log layout: magic, version, then per record step, timeMs, numAgent, payload bytes and the
+payload, all little endian 4 byte fields */
+struct GStepRecord {
+	int step;
+	float timeMs;
+	unsigned int numAgent;
+	std::vector<char> payload;	// filled by GModel::snapshot
+};
+
+template<class Consumer> class GOutputStage {
+	FILE *log;
+	Consumer *consumer;
+	std::deque<GStepRecord> queue;
+	std::mutex lock;
+	std::condition_variable notEmpty;
+	std::condition_variable notFull;
+	std::thread worker;
+	size_t depth;
+	int policy;
+	bool closing;
+
+	void write(const GStepRecord &rec) {
+		unsigned int bytes = (unsigned int)rec.payload.size();
+		fwrite(&rec.step, sizeof(int), 1, log);
+		fwrite(&rec.timeMs, sizeof(float), 1, log);
+		fwrite(&rec.numAgent, sizeof(unsigned int), 1, log);
+		fwrite(&bytes, sizeof(unsigned int), 1, log);
+		if (bytes > 0)
+			fwrite(&rec.payload[0], 1, bytes, log);
+	}
+	void run() {
+		std::unique_lock<std::mutex> guard(lock);
+		while (true) {
+			while (queue.empty() && !closing)
+				notEmpty.wait(guard);
+			if (queue.empty())
+				break;
+			GStepRecord rec;
+			rec.step = queue.front().step;
+			rec.timeMs = queue.front().timeMs;
+			rec.numAgent = queue.front().numAgent;
+			rec.payload.swap(queue.front().payload);
+			queue.pop_front();
+			notFull.notify_one();
+			guard.unlock();
+			if (log != NULL)
+				write(rec);
+			if (consumer != NULL)
+				consumer->consume(rec);
+			guard.lock();
+		}
+	}
+	static void runStage(GOutputStage *stage) {
+		stage->run();
+	}
+public:
+	unsigned int dropped;	// records lost to the policy
+
+	GOutputStage(const char *logName, Consumer *consumer, int policy, int depth)
+		: consumer(consumer), depth(depth < 1 ? 1 : depth), policy(policy), closing(false), dropped(0) {
+		log = fopen(logName, "wb");
+		if (log != NULL) {
+			setvbuf(log, NULL, _IOFBF, OUTPUT_LOG_BUFFER);
+			unsigned int head[2] = { OUTPUT_LOG_MAGIC, OUTPUT_LOG_VERSION };
+			fwrite(head, sizeof(unsigned int), 2, log);
+		}
+		worker = std::thread(runStage, this);
+	}
+	~GOutputStage() {
+		close();
+	}
+	// takes the payload of rec, rec is left empty
+	void push(GStepRecord &rec) {
+		std::unique_lock<std::mutex> guard(lock);
+		if (queue.size() >= depth) {
+			if (policy == OUTPUT_DROP_NEWEST) {
+				dropped++;
+				return;
+			}
+			if (policy == OUTPUT_DROP_OLDEST) {
+				queue.pop_front();
+				dropped++;
+			}
+			while (queue.size() >= depth)
+				notFull.wait(guard);
+		}
+		queue.push_back(GStepRecord());
+		GStepRecord &back = queue.back();
+		back.step = rec.step;
+		back.timeMs = rec.timeMs;
+		back.numAgent = rec.numAgent;
+		back.payload.swap(rec.payload);
+		notEmpty.notify_one();
+	}
+	// drains the queue and stops the thread
+	void close() {
+		if (!worker.joinable())
+			return;
+		{
+			std::lock_guard<std::mutex> guard(lock);
+			closing = true;
+		}
+		notEmpty.notify_one();
+		worker.join();
+		if (log != NULL) {
+			fclose(log);
+			log = NULL;
+		}
+		if (dropped > 0)
+			printf("output stage dropped %u records\n", dropped);
+	}
+};
+
+#endif
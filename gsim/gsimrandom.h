@@ -0,0 +1,53 @@
+#ifndef GSIMRANDOM_H
+#define GSIMRANDOM_H
+#include "inc/helper_math.h"
+
+/* counter based random numbers, Philox4x32-10 of Salmon et al., the generator of curand's
+curandStatePhilox4_32_10_t. A draw is a pure function of (seed, contextId, step, stream), so
+there is no per agent state, the draw of an agent does not depend on which thread runs it or in
+which order, and the host and the device give the same bits. Each call returns four words,
+stream tells apart the draws an agent makes within one step */
+#define PHILOX_M0 0xD2511F53
+#define PHILOX_M1 0xCD9E8D57
+#define PHILOX_W0 0x9E3779B9
+#define PHILOX_W1 0xBB67AE85
+#define PHILOX_ROUNDS 10
+
+namespace util{
+	__host__ __device__ inline unsigned int mulhilo(unsigned int a, unsigned int b, unsigned int &hi) {
+#ifdef __CUDA_ARCH__
+		hi = __umulhi(a, b);
+		return a * b;
+#else
+		unsigned long long p = (unsigned long long)a * b;
+		hi = (unsigned int)(p >> 32);
+		return (unsigned int)p;
+#endif
+	}
+	__host__ __device__ inline uint4 philox4x32(uint4 ctr, uint2 key) {
+		for (int r = 0; r < PHILOX_ROUNDS; r++) {
+			unsigned int hi0, hi1;
+			unsigned int lo0 = mulhilo(PHILOX_M0, ctr.x, hi0);
+			unsigned int lo1 = mulhilo(PHILOX_M1, ctr.z, hi1);
+			ctr = make_uint4(hi1 ^ ctr.y ^ key.x, lo1, hi0 ^ ctr.w ^ key.y, lo0);
+			key.x += PHILOX_W0;
+			key.y += PHILOX_W1;
+		}
+		return ctr;
+	}
+	__host__ __device__ inline uint4 randomBits(unsigned int seed, int contextId, int step, int stream) {
+		return philox4x32(make_uint4(contextId, step, stream, 0), make_uint2(seed, 0));
+	}
+	// (0, 1] as curand_uniform, 24 bits so that the float is exact on both sides
+	__host__ __device__ inline float randomUniform(unsigned int bits) {
+		return ((bits >> 8) + 1) * (1.0f / 16777216.0f);
+	}
+	// Box-Muller, the host and the device may differ in the last bit of logf, sinf and cosf
+	__host__ __device__ inline float randomGaussian(unsigned int bits0, unsigned int bits1) {
+		float u = randomUniform(bits0);
+		float v = randomUniform(bits1);
+		return sqrtf(-2.0f * logf(u)) * cosf(6.2831853f * v);
+	}
+};
+
+#endif